@@ -1,8 +1,22 @@
 #include "esp32-hal-ledc.h"
+#include "esp32-hal-ledc-sim.h"
+#include "sim_clock.h"
 #include <iostream>
 #include <atomic>
 #include <vector>
 #include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 // 确保此文件仅在 PC 平台上编译
 #ifndef PLATFORM_ESP32
@@ -16,91 +30,2086 @@
 
 // --- miniaudio 音频后端 ---
 
+#define SIM_SAMPLE_RATE 48000
+
+// HAL 一侧看到的通道寄存器，供 ledcRead / ledcReadFreq 等读回接口使用。
+// 音频线程不读取这里，它只通过命令队列接收变化。
 struct LedcChannelState {
-    std::atomic<double> frequency;
-    std::atomic<double> phase;
+    std::atomic<uint32_t> frequency; // 定时器实际输出的频率 (Hz)，与硬件一样经过分频取整
+    std::atomic<uint32_t> clock_divider; // 10.8 定点分频系数
     std::atomic<uint32_t> duty; // 0-1023 for 10-bit resolution
     std::atomic<uint32_t> resolution_max_duty; // e.g., 1023 for 10-bit
+    std::atomic<uint8_t> resolution; // 占空比分辨率位数
     std::atomic<bool> attached;
 };
 
 // 我们模拟 ESP32 的16个LEDC通道
 #define NUM_LEDC_CHANNELS 16
 static LedcChannelState g_ledc_channels[NUM_LEDC_CHANNELS];
+// 已附加且占空比非 0 的通道位图，由 HAL 调用维护；全为 0 时音频回调走静音快速路径
+static std::atomic<uint32_t> g_ledc_active_mask(0);
+
+static void update_active_mask(uint8_t channel, bool sounding) {
+    if (sounding) {
+        g_ledc_active_mask.fetch_or(1u << channel, std::memory_order_relaxed);
+    } else {
+        g_ledc_active_mask.fetch_and(~(1u << channel), std::memory_order_relaxed);
+    }
+}
 static std::vector<int> g_pin_to_channel(256, -1); // GPIO pin -> channel mapping
 
-static ma_device g_audio_device;
-static bool g_audio_initialized = false;
+static ma_device g_audio_device;
+static bool g_audio_initialized = false;
+
+// --- LEDC 定时器模型 ---
+// 与 ESP-IDF 的 ledc_timer_config 一致：输出频率 = 时钟源 / (分频系数 * 2^resolution)，
+// 分频系数是 10 位整数 + 8 位小数的定点数。LEDC_AUTO_CLK 时先尝试 80MHz APB 时钟，
+// 分频系数溢出（频率过低）时退回 1MHz REF_TICK。
+// 相位增量直接由时钟源和分频系数用整数运算得出，不经过浮点数，
+// 因此同样的调用序列在任何一次运行中都会得到逐位相同的输出，长时间运行也不会漂移。
+#define LEDC_APB_CLK_HZ 80000000u
+#define LEDC_REF_CLK_HZ 1000000u
+#define LEDC_DIV_FRAC_BITS 8
+#define LEDC_DIV_MIN (1u << LEDC_DIV_FRAC_BITS)   // 1.0
+#define LEDC_DIV_MAX ((1u << 18) - 1)              // 1023.996
+#define LEDC_MAX_BIT_WIDTH 20
+
+struct LedcTimerConfig {
+    uint32_t clock_hz;        // 选中的时钟源频率
+    uint32_t divider;         // 10.8 定点分频系数
+    uint32_t frequency;       // 实际输出频率 (Hz)
+    uint32_t phase_increment; // 在 SIM_SAMPLE_RATE 下每个采样的相位增量
+    bool above_nyquist;       // 基频高于 SIM_SAMPLE_RATE / 2，音频带内只剩平均电平
+};
+
+// 计算 (numerator << 32) / denominator 的低 32 位（四舍五入），逐位长除法避免 64 位溢出
+static uint32_t fixed_point_ratio(uint64_t numerator, uint64_t denominator) {
+    uint64_t remainder = numerator % denominator;
+    uint32_t result = (uint32_t)(numerator / denominator); // 超过 2^32 的整数部分按相位回绕丢弃
+    for (int bit = 0; bit < 32; ++bit) {
+        remainder <<= 1;
+        result <<= 1;
+        if (remainder >= denominator) {
+            remainder -= denominator;
+            result |= 1;
+        }
+    }
+    if ((remainder << 1) >= denominator) ++result;
+    return result;
+}
+
+static bool ledc_calc_timer(uint32_t freq, uint8_t resolution, LedcTimerConfig* cfg) {
+    if (freq == 0 || resolution == 0 || resolution > LEDC_MAX_BIT_WIDTH) {
+        return false;
+    }
+    const uint32_t clocks[] = { LEDC_APB_CLK_HZ, LEDC_REF_CLK_HZ };
+    const uint64_t precision = (uint64_t)1 << resolution;
+    for (uint32_t clock_hz : clocks) {
+        uint64_t div = (((uint64_t)clock_hz << LEDC_DIV_FRAC_BITS) + freq * precision / 2) / (freq * precision);
+        if (div < LEDC_DIV_MIN || div > LEDC_DIV_MAX) {
+            continue;
+        }
+        uint64_t numerator = (uint64_t)clock_hz << LEDC_DIV_FRAC_BITS;
+        uint64_t period = div * precision; // 以 1/256 个时钟周期为单位的 PWM 周期
+        cfg->clock_hz = clock_hz;
+        cfg->divider = (uint32_t)div;
+        cfg->frequency = (uint32_t)(numerator / period);
+        cfg->phase_increment = fixed_point_ratio(numerator, period * SIM_SAMPLE_RATE);
+        cfg->above_nyquist = 2 * numerator > period * SIM_SAMPLE_RATE;
+        return true;
+    }
+    return false;
+}
+
+// 把定时器配置写入通道寄存器，失败时与真机一样打印错误并保持原配置
+static bool ledc_apply_timer(uint8_t channel, uint32_t freq, uint8_t resolution, LedcTimerConfig* cfg) {
+    if (!ledc_calc_timer(freq, resolution, cfg)) {
+        log_e("LEDC timer: requested frequency %u Hz and %d-bit resolution can not be achieved", freq, resolution);
+        return false;
+    }
+    g_ledc_channels[channel].clock_divider.store(cfg->divider);
+    g_ledc_channels[channel].frequency.store(cfg->frequency);
+    g_ledc_channels[channel].resolution_max_duty.store((1u << resolution) - 1);
+    g_ledc_channels[channel].resolution.store(resolution);
+    return true;
+}
+
+// --- 带限振荡器 (BLEP) ---
+// 朴素方波的每个跳变沿都是理想阶跃，高于几 kHz 的音调其谐波会折叠回音频带内。
+// 这里在检测到跳变沿时，按其亚采样位置叠加一段"带限阶跃残差"(BLEP)，
+// 其余采样仍走朴素方波路径，因此额外开销只与跳变沿数量有关，与采样数无关。
+//
+// 残差会落在跳变沿之前的采样上，所以所有通道先混合到 g_mix_buffer，
+// 整体输出固定延迟 BLEP_HALF_TAPS 个采样（48kHz 下约 0.17ms）。
+// 三种振荡器使用相同的延迟，运行时切换不会产生错位。
+#define BLEP_HALF_TAPS 8            // 查表 BLEP 单侧宽度（采样数），同时也是输出延迟
+#define BLEP_TABLE_OVERSAMPLE 64    // 残差表在每个采样间隔内的细分数
+#define BLEP_TABLE_SIZE (2 * BLEP_HALF_TAPS * BLEP_TABLE_OVERSAMPLE + 2)
+#define RENDER_CHUNK_FRAMES 512     // 每次内部渲染的最大帧数
+#define CHANNEL_AMPLITUDE 0.1f      // 单通道幅度，多个通道时需要减小
+
+static float g_blep_table[BLEP_TABLE_SIZE];
+static std::atomic<int> g_osc_mode(LEDC_SIM_OSC_POLYBLEP);
+static std::atomic<int> g_render_mode(LEDC_SIM_RENDER_AUTO);
+
+// 混合缓冲区：[0, 2*BLEP_HALF_TAPS) 保存上一块延续过来的残差
+static float g_mix_buffer[RENDER_CHUNK_FRAMES + 2 * BLEP_HALF_TAPS];
+
+// 生成查表 BLEP 使用的带限阶跃：对 Blackman 窗 sinc 积分并归一化到 [0, 1]。
+// 表中保存的是平滑的阶跃本身而不是残差，残差在 x = 0 处的跳变由 add_blep 按采样位置减去，
+// 这样线性插值永远不会跨越不连续点。
+static void init_blep_table() {
+    const int n = 2 * BLEP_HALF_TAPS * BLEP_TABLE_OVERSAMPLE;
+    const double cutoff = 0.45; // 截止频率（相对采样率），略低于奈奎斯特频率
+    std::vector<double> step(n + 1);
+    double sum = 0.0;
+    double prev = 0.0;
+    for (int i = 0; i <= n; ++i) {
+        double x = (double)i / BLEP_TABLE_OVERSAMPLE - BLEP_HALF_TAPS;
+        double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+        double w = (double)i / n;
+        double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * w) + 0.08 * std::cos(4.0 * M_PI * w);
+        double h = sinc * window;
+        if (i > 0) sum += 0.5 * (prev + h); // 梯形积分
+        step[i] = sum;
+        prev = h;
+    }
+    for (int i = 0; i <= n; ++i) {
+        g_blep_table[i] = (float)(step[i] / sum);
+    }
+    g_blep_table[n + 1] = 1.0f; // 线性插值时的哨兵
+}
+
+// 在混合缓冲区中叠加一个跳变沿的残差。
+// dst 指向跳变沿前一个采样 n 之后的位置（即 &mix[n + 1]），跳变沿发生在 n + frac，
+// frac ∈ (0, 1]；height 为阶跃高度（上升为正，下降为负）。
+// 强制内联：SIMD 内核用不同的指令集编译，内联后残差代码随内核一起编码，避免 SSE/AVX 切换开销
+static inline __attribute__((always_inline)) void add_blep(float* dst, float frac, float height, int mode) {
+    if (mode == LEDC_SIM_OSC_POLYBLEP) {
+        // 二次多项式近似：跳变沿前后各修正一个采样
+        float before = 1.0f - frac;
+        dst[BLEP_HALF_TAPS - 1] += height * 0.5f * before * before;
+        dst[BLEP_HALF_TAPS]     -= height * 0.5f * frac * frac;
+    } else {
+        // 第 k 个修正采样相对跳变沿的位置为 k + 1 - BLEP_HALF_TAPS - frac，
+        // 前 BLEP_HALF_TAPS 个位于跳变沿之前，其余位于之后（朴素方波已经跳变）
+        float pos = (1.0f - frac) * BLEP_TABLE_OVERSAMPLE;
+        int idx = (int)pos;
+        float t = pos - (float)idx;
+        for (int k = 0; k < 2 * BLEP_HALF_TAPS; ++k, idx += BLEP_TABLE_OVERSAMPLE) {
+            float r = g_blep_table[idx] + t * (g_blep_table[idx + 1] - g_blep_table[idx]);
+            dst[k] += height * (k < BLEP_HALF_TAPS ? r : r - 1.0f);
+        }
+    }
+}
+
+// --- 结构数组 (SoA) 混音器 ---
+// 所有通道的渲染参数按字段分别存成对齐的数组，混音内核在一次遍历中同时推进全部通道：
+// 每个输出采样先用向量指令求出各通道电平并横向求和，再统一检查是否有通道跨过跳变沿。
+// 只有跨过跳变沿的通道才退回标量代码叠加 BLEP 残差，所以跳变沿仍然是按沿计费的。
+// 内核在运行时按 CPU 能力选择 AVX2 / SSE2，其他平台使用标量实现。
+struct LedcRenderState {
+    alignas(32) uint32_t phase[NUM_LEDC_CHANNELS];     // 32 位相位累加器，与 LEDC 计数器一样自然回绕
+    alignas(32) uint32_t increment[NUM_LEDC_CHANNELS]; // 每个采样的相位增量，静音通道为 0
+    alignas(32) uint32_t threshold[NUM_LEDC_CHANNELS]; // 相位低于该值时输出高电平
+    alignas(32) float gain[NUM_LEDC_CHANNELS];         // 通道幅度，静音通道为 0
+    uint32_t active_mask;                              // 正在发声的通道位图（increment 非 0）
+};
+
+static LedcRenderState g_render; // 仅由音频线程访问
+
+typedef void (*MixKernel)(LedcRenderState& st, int lanes, float* mix, uint32_t frames, int mode);
+
+// 处理一个采样内跨过跳变沿的通道。phase 为推进后的相位，edges 的每一位对应一个通道
+static inline __attribute__((always_inline)) void apply_lane_edges(const LedcRenderState& st, const uint32_t* phase, uint32_t edges, float* dst, int mode) {
+    while (edges) {
+        int lane = __builtin_ctz(edges);
+        edges &= edges - 1;
+        uint32_t inc = st.increment[lane];
+        uint32_t old = phase[lane] - inc;
+        float inv_increment = 1.0f / (float)inc;
+        float height = 2.0f * st.gain[lane];
+        if ((uint32_t)(st.threshold[lane] - old - 1) < inc) { // 下降沿
+            add_blep(dst, (float)(st.threshold[lane] - old) * inv_increment, -height, mode);
+        }
+        if (~old < inc) { // 计数器回绕，即上升沿
+            add_blep(dst, (float)(0u - old) * inv_increment, height, mode);
+        }
+    }
+}
+
+// 标量内核，mix[n + BLEP_HALF_TAPS] 对应第 n 帧
+static void mix_kernel_scalar(LedcRenderState& st, int lanes, float* mix, uint32_t frames, int mode) {
+    (void)lanes;
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        float sum = 0.0f;
+        uint32_t edges = 0;
+        for (uint32_t bits = st.active_mask; bits; bits &= bits - 1) {
+            int lane = __builtin_ctz(bits);
+            uint32_t phase = st.phase[lane];
+            uint32_t inc = st.increment[lane];
+            sum += (phase < st.threshold[lane]) ? st.gain[lane] : -st.gain[lane];
+            // 在 (phase, phase + inc] 内经过跳变点 e 等价于 (e - phase - 1) mod 2^32 < inc
+            if ((uint32_t)(st.threshold[lane] - phase - 1) < inc || ~phase < inc) {
+                edges |= 1u << lane;
+            }
+            st.phase[lane] = phase + inc;
+        }
+        mix[frame + BLEP_HALF_TAPS] += sum;
+        if (edges && mode != LEDC_SIM_OSC_NAIVE) {
+            apply_lane_edges(st, st.phase, edges, mix + frame + 1, mode);
+        }
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEDC_SIM_X86_KERNELS 1
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void mix_kernel_sse2(LedcRenderState& st, int lanes, float* mix, uint32_t frames, int mode) {
+    const int groups = (lanes + 3) / 4;
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i phase[NUM_LEDC_CHANNELS / 4], inc_s[NUM_LEDC_CHANNELS / 4], thr_s[NUM_LEDC_CHANNELS / 4], inc[NUM_LEDC_CHANNELS / 4];
+    __m128 gain[NUM_LEDC_CHANNELS / 4];
+    for (int g = 0; g < groups; ++g) {
+        phase[g] = _mm_load_si128((const __m128i*)&st.phase[g * 4]);
+        inc[g] = _mm_load_si128((const __m128i*)&st.increment[g * 4]);
+        inc_s[g] = _mm_xor_si128(inc[g], sign); // SSE2 只有有符号比较，翻转符号位实现无符号比较
+        thr_s[g] = _mm_load_si128((const __m128i*)&st.threshold[g * 4]);
+        gain[g] = _mm_load_ps(&st.gain[g * 4]);
+    }
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        __m128 sum = _mm_setzero_ps();
+        int edges = 0;
+        for (int g = 0; g < groups; ++g) {
+            __m128i thr = thr_s[g];
+            __m128i p = phase[g];
+            __m128i high = _mm_cmplt_epi32(_mm_xor_si128(p, sign), _mm_xor_si128(thr, sign));
+            // 低电平时翻转 gain 的符号位
+            sum = _mm_add_ps(sum, _mm_xor_ps(gain[g], _mm_castsi128_ps(_mm_andnot_si128(high, sign))));
+            __m128i to_fall = _mm_add_epi32(_mm_sub_epi32(thr, p), ones);
+            __m128i to_wrap = _mm_xor_si128(p, ones);
+            __m128i edge = _mm_or_si128(_mm_cmplt_epi32(_mm_xor_si128(to_fall, sign), inc_s[g]),
+                                        _mm_cmplt_epi32(_mm_xor_si128(to_wrap, sign), inc_s[g]));
+            edges |= _mm_movemask_ps(_mm_castsi128_ps(edge)) << (g * 4);
+            phase[g] = _mm_add_epi32(p, inc[g]);
+        }
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        mix[frame + BLEP_HALF_TAPS] += _mm_cvtss_f32(sum);
+        if (edges && mode != LEDC_SIM_OSC_NAIVE) {
+            alignas(16) uint32_t now[NUM_LEDC_CHANNELS];
+            for (int g = 0; g < groups; ++g) _mm_store_si128((__m128i*)&now[g * 4], phase[g]);
+            apply_lane_edges(st, now, (uint32_t)edges, mix + frame + 1, mode);
+        }
+    }
+    for (int g = 0; g < groups; ++g) {
+        _mm_store_si128((__m128i*)&st.phase[g * 4], phase[g]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void mix_kernel_avx2(LedcRenderState& st, int lanes, float* mix, uint32_t frames, int mode) {
+    const int groups = (lanes + 7) / 8;
+    const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i phase[NUM_LEDC_CHANNELS / 8], inc_s[NUM_LEDC_CHANNELS / 8], thr_s[NUM_LEDC_CHANNELS / 8], inc[NUM_LEDC_CHANNELS / 8];
+    __m256 gain[NUM_LEDC_CHANNELS / 8];
+    for (int g = 0; g < groups; ++g) {
+        phase[g] = _mm256_load_si256((const __m256i*)&st.phase[g * 8]);
+        inc[g] = _mm256_load_si256((const __m256i*)&st.increment[g * 8]);
+        inc_s[g] = _mm256_xor_si256(inc[g], sign);
+        thr_s[g] = _mm256_load_si256((const __m256i*)&st.threshold[g * 8]);
+        gain[g] = _mm256_load_ps(&st.gain[g * 8]);
+    }
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        __m256 sum = _mm256_setzero_ps();
+        int edges = 0;
+        for (int g = 0; g < groups; ++g) {
+            __m256i thr = thr_s[g];
+            __m256i p = phase[g];
+            __m256i high = _mm256_cmpgt_epi32(_mm256_xor_si256(thr, sign), _mm256_xor_si256(p, sign));
+            sum = _mm256_add_ps(sum, _mm256_xor_ps(gain[g], _mm256_castsi256_ps(_mm256_andnot_si256(high, sign))));
+            __m256i to_fall = _mm256_add_epi32(_mm256_sub_epi32(thr, p), ones);
+            __m256i to_wrap = _mm256_xor_si256(p, ones);
+            __m256i edge = _mm256_or_si256(_mm256_cmpgt_epi32(inc_s[g], _mm256_xor_si256(to_fall, sign)),
+                                           _mm256_cmpgt_epi32(inc_s[g], _mm256_xor_si256(to_wrap, sign)));
+            edges |= _mm256_movemask_ps(_mm256_castsi256_ps(edge)) << (g * 8);
+            phase[g] = _mm256_add_epi32(p, inc[g]);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        mix[frame + BLEP_HALF_TAPS] += _mm_cvtss_f32(half);
+        if (edges && mode != LEDC_SIM_OSC_NAIVE) {
+            alignas(32) uint32_t now[NUM_LEDC_CHANNELS];
+            for (int g = 0; g < groups; ++g) _mm256_store_si256((__m256i*)&now[g * 8], phase[g]);
+            apply_lane_edges(st, now, (uint32_t)edges, mix + frame + 1, mode);
+        }
+    }
+    for (int g = 0; g < groups; ++g) {
+        _mm256_store_si256((__m256i*)&st.phase[g * 8], phase[g]);
+    }
+}
+#endif // x86
+
+// 按 CPU 能力选择混音内核，只在第一次调用时检测
+static MixKernel select_mix_kernel() {
+#ifdef LEDC_SIM_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return mix_kernel_avx2;
+    if (__builtin_cpu_supports("sse2")) return mix_kernel_sse2;
+#endif
+    return mix_kernel_scalar;
+}
+
+static MixKernel g_mix_kernel = select_mix_kernel();
+
+// --- 跳变沿列表渲染器 ---
+// 方波完全由它的跳变时刻决定。低频时相邻跳变沿相隔成百上千个采样，逐采样推进相位纯属浪费：
+// 这里直接用整数除法算出每个通道在本块内的跳变沿，把所有通道的跳变沿按时间归并成一条有序流，
+// 两个跳变沿之间的总电平是常数，用向量指令整段累加，只在跳变沿处叠加 BLEP 残差。
+// 工作量与跳变沿数量成正比，而不是与采样数成正比。
+#define EDGE_LIST_MAX_DENSITY 0.25 // 自动模式下，平均每个采样的跳变沿数低于此值时使用跳变沿列表
+
+static void add_constant_run_scalar(float* dst, uint32_t count, float value) {
+    for (uint32_t i = 0; i < count; ++i) dst[i] += value;
+}
+
+#ifdef LEDC_SIM_X86_KERNELS
+__attribute__((target("sse2")))
+static void add_constant_run_sse2(float* dst, uint32_t count, float value) {
+    const __m128 v = _mm_set1_ps(value);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm_storeu_ps(dst + i,      _mm_add_ps(_mm_loadu_ps(dst + i), v));
+        _mm_storeu_ps(dst + i + 4,  _mm_add_ps(_mm_loadu_ps(dst + i + 4), v));
+        _mm_storeu_ps(dst + i + 8,  _mm_add_ps(_mm_loadu_ps(dst + i + 8), v));
+        _mm_storeu_ps(dst + i + 12, _mm_add_ps(_mm_loadu_ps(dst + i + 12), v));
+    }
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+    }
+    for (; i < count; ++i) dst[i] += value;
+}
+#endif
+
+typedef void (*ConstantRunFn)(float* dst, uint32_t count, float value);
+
+static ConstantRunFn select_constant_run() {
+#ifdef LEDC_SIM_X86_KERNELS
+    if (__builtin_cpu_supports("sse2")) return add_constant_run_sse2;
+#endif
+    return add_constant_run_scalar;
+}
+
+static ConstantRunFn g_add_constant_run = select_constant_run();
+
+// 一个通道的下一个跳变沿。fall / rise 是从块起始相位到下降沿 / 上升沿的相位距离（可超过 2^32）
+struct EdgeCursor {
+    uint64_t fall;
+    uint64_t rise;
+    uint64_t sample; // 电平改变后的第一个采样
+    float frac;      // 跳变沿位于 sample - 1 + frac
+    float delta;     // 电平变化量
+    bool falling;
+};
+
+static inline void next_edge(EdgeCursor& c, uint32_t inc, float gain) {
+    c.falling = c.fall < c.rise;
+    uint64_t distance = c.falling ? c.fall : c.rise;
+    c.sample = (distance + inc - 1) / inc;
+    c.frac = (float)(distance - (c.sample - 1) * inc) / (float)inc;
+    c.delta = c.falling ? -2.0f * gain : 2.0f * gain;
+}
+
+static void mix_edge_list(LedcRenderState& st, int lanes, float* mix, uint32_t frames, int mode) {
+    const uint64_t period = (uint64_t)1 << 32;
+    EdgeCursor cursor[NUM_LEDC_CHANNELS];
+    int active[NUM_LEDC_CHANNELS];
+    int count = 0;
+    float level = 0.0f;
+    (void)lanes;
+    for (uint32_t bits = st.active_mask; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint32_t inc = st.increment[lane];
+        uint32_t phase = st.phase[lane];
+        EdgeCursor& c = cursor[lane];
+        level += (phase < st.threshold[lane]) ? st.gain[lane] : -st.gain[lane];
+        c.fall = (uint32_t)(st.threshold[lane] - phase);
+        c.rise = (uint32_t)(0u - phase);
+        if (c.fall == 0) c.fall = period;
+        if (c.rise == 0) c.rise = period;
+        next_edge(c, inc, st.gain[lane]);
+        active[count++] = lane;
+    }
+
+    float* out = mix + BLEP_HALF_TAPS;
+    uint32_t pos = 0;
+    for (;;) {
+        // 归并：取所有通道中最早的跳变沿。sample == frames 的跳变沿位于本块最后一个采样之后，
+        // 电平变化属于下一块，但它的 BLEP 残差必须在本块叠加（逐采样内核也是如此）
+        int best = -1;
+        uint64_t best_sample = (uint64_t)frames + 1;
+        for (int i = 0; i < count; ++i) {
+            if (cursor[active[i]].sample < best_sample) {
+                best_sample = cursor[active[i]].sample;
+                best = active[i];
+            }
+        }
+        if (best < 0) break;
+
+        EdgeCursor& c = cursor[best];
+        g_add_constant_run(out + pos, (uint32_t)best_sample - pos, level);
+        pos = (uint32_t)best_sample;
+        level += c.delta;
+        if (mode != LEDC_SIM_OSC_NAIVE) {
+            add_blep(mix + best_sample, c.frac, c.delta, mode);
+        }
+        if (c.falling) c.fall += period; else c.rise += period;
+        next_edge(c, st.increment[best], st.gain[best]);
+    }
+    g_add_constant_run(out + pos, frames - pos, level);
+
+    for (int i = 0; i < count; ++i) {
+        int lane = active[i];
+        st.phase[lane] += st.increment[lane] * frames;
+    }
+}
+
+// --- 过采样 PWM 域 ---
+// LEDC 可以输出远高于音频采样率的 PWM，例如 20kHz 载波加占空比调制（PWM-DAC）。
+// 48kHz 下的 BLEP 只对单个跳变沿做带限，载波的高次谐波与调制边带仍会折叠成噪声。
+// 打开过采样的通道改为在 OVERSAMPLE_FACTOR 倍采样率下生成波形：每个子采样取该子采样区间内电平的精确平均值
+// （按相位区间与高电平区间的重叠长度计算，相当于盒式滤波后采样，否则载波的高次谐波在 768kHz 下同样会混叠），
+// 量化为定点整数后累加，然后经多级抽取滤波降回 SIM_SAMPLE_RATE：
+//   768kHz --CIC(4 阶, /4)--> 192kHz --半带 FIR(7 抽头, /2)--> 96kHz --半带 FIR(27 抽头, /2)--> 48kHz
+// 所有过采样通道先求和再进入同一条滤波链，所以滤波开销与过采样通道数无关，
+// 只有打开过采样的通道才需要逐个生成高采样率电平，其余通道仍走原来的渲染路径。
+//
+// 滤波链的群延迟加上子采样的相位偏移恰好等于 BLEP_HALF_TAPS 个采样，
+// 与其他通道对齐，运行时切换过采样不会产生错位。
+#define OVERSAMPLE_FACTOR 16
+#define CIC_ORDER 4
+#define CIC_DECIMATION 4
+#define HALFBAND1_HALF 2           // 第一级半带滤波器：4 * 2 - 1 = 7 抽头 @192kHz
+#define HALFBAND2_HALF 7           // 第二级半带滤波器：4 * 7 - 1 = 27 抽头 @96kHz
+#define HALFBAND_MAX_COEFFS 16     // 非零抽头数 2 * half 向上取整到 4 的倍数
+#define HALFBAND_KAISER_BETA 5.0
+// 以子采样为单位的群延迟：CIC 为 N(R-1)/2，每级半带为 (2 * half - 1) 个输入采样
+#define OVERSAMPLE_FILTER_DELAY (CIC_ORDER * (CIC_DECIMATION - 1) / 2 + \
+                                 CIC_DECIMATION * (2 * HALFBAND1_HALF - 1) + \
+                                 2 * CIC_DECIMATION * (2 * HALFBAND2_HALF - 1))
+// 补足到 BLEP_HALF_TAPS 个采样所需的子采样相位滞后
+#define OVERSAMPLE_PHASE_LAG (BLEP_HALF_TAPS * OVERSAMPLE_FACTOR - OVERSAMPLE_FILTER_DELAY)
+#define CIC_GAIN (CIC_DECIMATION * CIC_DECIMATION * CIC_DECIMATION * CIC_DECIMATION) // R^N
+#define OVERSAMPLE_LEVEL_ONE 4096  // 子采样电平 ±1 对应的定点值，16 个通道经 CIC 增益后仍远小于 2^31
+#define OVERSAMPLE_TAIL_FRAMES (2 * BLEP_HALF_TAPS) // 最后一个通道关闭后继续运行滤波链的帧数
+
+// 半带滤波器除中心抽头 (0.5) 外只有一半抽头非零，按多相结构拆成奇偶两路：
+// 非零抽头组成的一路做点积，中心抽头那一路只需乘 0.5
+struct HalfbandStage {
+    float odd[2 * RENDER_CHUNK_FRAMES + HALFBAND_MAX_COEFFS + 4];  // 与非零抽头相乘的输入（含历史）
+    float even[2 * RENDER_CHUNK_FRAMES + HALFBAND_MAX_COEFFS + 4]; // 与中心抽头相乘的输入（含历史）
+};
+
+struct OversampleState {
+    uint32_t phase[NUM_LEDC_CHANNELS];
+    uint32_t increment[NUM_LEDC_CHANNELS];
+    uint32_t threshold[NUM_LEDC_CHANNELS];
+    alignas(16) uint32_t sub_end[NUM_LEDC_CHANNELS][OVERSAMPLE_FACTOR];   // 各子采样区间终点相对帧相位的滞后量
+    alignas(16) uint32_t sub_start[NUM_LEDC_CHANNELS][OVERSAMPLE_FACTOR]; // 各子采样区间起点相对帧相位的滞后量
+    float area_scale[NUM_LEDC_CHANNELS]; // 高电平相位长度 -> 定点电平的比例，2 * OVERSAMPLE_LEVEL_ONE / 子采样相位增量
+    uint32_t active_mask;  // 正在发声的过采样通道
+    uint32_t tail_frames;  // 滤波链还需运行的帧数
+    uint32_t integrator[CIC_ORDER]; // CIC 状态，按 2^32 取模运算，输出有界所以回绕不影响结果
+    uint32_t comb_delay[CIC_ORDER];
+    HalfbandStage halfband1;
+    HalfbandStage halfband2;
+    int32_t sub[RENDER_CHUNK_FRAMES * OVERSAMPLE_FACTOR]; // 子采样电平之和（定点）
+    float cic_out[RENDER_CHUNK_FRAMES * OVERSAMPLE_FACTOR / CIC_DECIMATION];
+    float halfband1_out[RENDER_CHUNK_FRAMES * 2];
+    float halfband2_out[RENDER_CHUNK_FRAMES];
+};
+
+static OversampleState g_oversample;                  // 仅由音频线程访问
+static std::atomic<uint32_t> g_oversample_request(0); // 模拟器接口设置的过采样通道位图
+static uint32_t g_oversample_lanes = 0;               // 音频线程当前采用的位图
+
+// 零填充到 HALFBAND_MAX_COEFFS，点积可以固定按 4 个一组计算
+static float g_halfband1_coeff[HALFBAND_MAX_COEFFS];
+static float g_halfband2_coeff[HALFBAND_MAX_COEFFS];
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// Kaiser 窗半带滤波器，只保存非零抽头 h[0], h[2], ..., h[4 * half - 2]，归一化使直流增益为 1
+static void design_halfband(float* coeff, int half) {
+    const int taps = 4 * half - 1;
+    const int center = 2 * half - 1;
+    double h[HALFBAND_MAX_COEFFS];
+    double sum = 0.0;
+    for (int j = 0; j < 2 * half; ++j) {
+        int n = 2 * j;
+        double t = n - center;
+        double r = 2.0 * n / (taps - 1) - 1.0;
+        double window = bessel_i0(HALFBAND_KAISER_BETA * std::sqrt(1.0 - r * r)) / bessel_i0(HALFBAND_KAISER_BETA);
+        h[j] = std::sin(M_PI * t / 2.0) / (M_PI * t) * window;
+        sum += h[j];
+    }
+    for (int j = 0; j < HALFBAND_MAX_COEFFS; ++j) {
+        coeff[j] = j < 2 * half ? (float)(h[j] * 0.5 / sum) : 0.0f;
+    }
+}
+
+static void init_halfband_filters() {
+    design_halfband(g_halfband1_coeff, HALFBAND1_HALF);
+    design_halfband(g_halfband2_coeff, HALFBAND2_HALF);
+}
+
+static void reset_oversample_filters(OversampleState& os) {
+    memset(os.integrator, 0, sizeof(os.integrator));
+    memset(os.comb_delay, 0, sizeof(os.comb_delay));
+    memset(&os.halfband1, 0, sizeof(os.halfband1));
+    memset(&os.halfband2, 0, sizeof(os.halfband2));
+}
+
+// 设置过采样通道参数，increment 为 0 表示静音。
+// 第 j 个子采样区间的终点位于帧相位之前 (OVERSAMPLE_FACTOR - 1 - j + OVERSAMPLE_PHASE_LAG) / OVERSAMPLE_FACTOR
+// 个采样处，起点是前一个子采样的终点。偏移量由 64 位整数算出，第 0 个子采样的起点恰好等于上一帧
+// 最后一个子采样的终点，子采样网格首尾相接，不会累积误差
+static void set_oversample_lane(OversampleState& os, int ch, uint32_t increment, uint32_t threshold) {
+    os.increment[ch] = increment;
+    os.threshold[ch] = threshold;
+    for (int j = 0; j < OVERSAMPLE_FACTOR; ++j) {
+        uint64_t lag = (uint64_t)increment * (OVERSAMPLE_FACTOR - 1 - j + OVERSAMPLE_PHASE_LAG);
+        os.sub_end[ch][j] = (uint32_t)((lag + OVERSAMPLE_FACTOR / 2) / OVERSAMPLE_FACTOR);
+    }
+    os.sub_start[ch][0] = os.sub_end[ch][OVERSAMPLE_FACTOR - 1] + increment;
+    for (int j = 1; j < OVERSAMPLE_FACTOR; ++j) os.sub_start[ch][j] = os.sub_end[ch][j - 1];
+    os.area_scale[ch] = increment ? 2.0f * OVERSAMPLE_LEVEL_ONE * OVERSAMPLE_FACTOR / (float)increment : 0.0f;
+    if (increment != 0) {
+        os.active_mask |= 1u << ch;
+        os.tail_frames = OVERSAMPLE_TAIL_FRAMES;
+    } else {
+        os.active_mask &= ~(1u << ch);
+    }
+}
+
+typedef void (*SubsampleFn)(OversampleState& os, uint32_t frames);
+typedef void (*HalfbandFn)(HalfbandStage& st, const float* coeff, int half, const float* in, uint32_t out_count, float* out);
+
+// 相位区间 (start, end] 中高电平 [0, threshold) 的长度。区间跨过计数器回绕时加上完整的一段高电平
+static inline uint32_t high_overlap(uint32_t start, uint32_t end, uint32_t threshold) {
+    uint32_t overlap = std::min(end, threshold) - std::min(start, threshold);
+    return end < start ? overlap + threshold : overlap;
+}
+
+// 生成 frames * OVERSAMPLE_FACTOR 个子采样，每个值为各过采样通道在子采样区间内的平均电平之和，
+// 电平 +1 / -1 对应 ±OVERSAMPLE_LEVEL_ONE
+static void generate_subsamples_scalar(OversampleState& os, uint32_t frames) {
+    const int32_t base = -OVERSAMPLE_LEVEL_ONE * __builtin_popcount(os.active_mask);
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        int32_t* dst = os.sub + frame * OVERSAMPLE_FACTOR;
+        for (int j = 0; j < OVERSAMPLE_FACTOR; ++j) dst[j] = base;
+        for (uint32_t bits = os.active_mask; bits; bits &= bits - 1) {
+            int lane = __builtin_ctz(bits);
+            uint32_t phase = os.phase[lane];
+            for (int j = 0; j < OVERSAMPLE_FACTOR; ++j) {
+                uint32_t high = high_overlap(phase - os.sub_start[lane][j], phase - os.sub_end[lane][j], os.threshold[lane]);
+                dst[j] += (int32_t)std::lrint((float)high * os.area_scale[lane]);
+            }
+            os.phase[lane] = phase + os.increment[lane];
+        }
+    }
+}
+
+// 半带抽取：输入 2 * out_count 个采样，输出 out_count 个。
+// 奇数位置的输入（每对中较新的一个）与非零抽头相乘，偶数位置的输入与中心抽头相乘；
+// 半带滤波器是对称的，因此点积可以直接在按时间顺序存放的历史上正向进行
+static void halfband_scalar(HalfbandStage& st, const float* coeff, int half, const float* in, uint32_t out_count, float* out) {
+    const int odd_history = 2 * half - 1;
+    const int even_history = half - 1;
+    for (uint32_t m = 0; m < out_count; ++m) {
+        st.even[even_history + m] = in[2 * m];
+        st.odd[odd_history + m] = in[2 * m + 1];
+    }
+    for (uint32_t m = 0; m < out_count; ++m) {
+        float sum = 0.5f * st.even[m];
+        for (int j = 0; j < 2 * half; ++j) sum += coeff[j] * st.odd[m + j];
+        out[m] = sum;
+    }
+    memmove(st.odd, st.odd + out_count, odd_history * sizeof(float));
+    memmove(st.even, st.even + out_count, even_history * sizeof(float));
+}
+
+#ifdef LEDC_SIM_X86_KERNELS
+// 无符号 min：SSE2 只有有符号比较，操作数预先翻转了符号位
+__attribute__((target("sse2")))
+static inline __m128i min_epu32_biased(__m128i a_s, __m128i b_s) {
+    __m128i a_less = _mm_cmplt_epi32(a_s, b_s);
+    return _mm_or_si128(_mm_and_si128(a_less, a_s), _mm_andnot_si128(a_less, b_s));
+}
+
+__attribute__((target("sse2")))
+static void generate_subsamples_sse2(OversampleState& os, uint32_t frames) {
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i base = _mm_set1_epi32(-OVERSAMPLE_LEVEL_ONE * __builtin_popcount(os.active_mask));
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        __m128i acc[OVERSAMPLE_FACTOR / 4];
+        for (int g = 0; g < OVERSAMPLE_FACTOR / 4; ++g) acc[g] = base;
+        for (uint32_t bits = os.active_mask; bits; bits &= bits - 1) {
+            int lane = __builtin_ctz(bits);
+            const __m128i* end_offset = (const __m128i*)os.sub_end[lane];
+            const __m128i* start_offset = (const __m128i*)os.sub_start[lane];
+            __m128i p = _mm_set1_epi32((int)os.phase[lane]);
+            __m128i thr = _mm_set1_epi32((int)os.threshold[lane]);
+            __m128i thr_s = _mm_xor_si128(thr, sign);
+            __m128 scale = _mm_set1_ps(os.area_scale[lane]);
+            for (int g = 0; g < OVERSAMPLE_FACTOR / 4; ++g) {
+                __m128i end_s = _mm_xor_si128(_mm_sub_epi32(p, _mm_load_si128(end_offset + g)), sign);
+                __m128i start_s = _mm_xor_si128(_mm_sub_epi32(p, _mm_load_si128(start_offset + g)), sign);
+                __m128i overlap = _mm_sub_epi32(min_epu32_biased(end_s, thr_s), min_epu32_biased(start_s, thr_s));
+                __m128i wrapped = _mm_cmplt_epi32(end_s, start_s);
+                overlap = _mm_add_epi32(overlap, _mm_and_si128(wrapped, thr));
+                // 重叠长度不超过子采样相位增量（< 2^31），可以按有符号数转换
+                acc[g] = _mm_add_epi32(acc[g], _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(overlap), scale)));
+            }
+            os.phase[lane] += os.increment[lane];
+        }
+        __m128i* dst = (__m128i*)(os.sub + frame * OVERSAMPLE_FACTOR);
+        for (int g = 0; g < OVERSAMPLE_FACTOR / 4; ++g) _mm_storeu_si128(dst + g, acc[g]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void halfband_sse2(HalfbandStage& st, const float* coeff, int half, const float* in, uint32_t out_count, float* out) {
+    const int odd_history = 2 * half - 1;
+    const int even_history = half - 1;
+    const int groups = (2 * half + 3) / 4; // 多出的抽头系数为 0
+    for (uint32_t m = 0; m < out_count; ++m) {
+        st.even[even_history + m] = in[2 * m];
+        st.odd[odd_history + m] = in[2 * m + 1];
+    }
+    __m128 c[HALFBAND_MAX_COEFFS / 4];
+    for (int g = 0; g < groups; ++g) c[g] = _mm_loadu_ps(coeff + g * 4);
+    for (uint32_t m = 0; m < out_count; ++m) {
+        __m128 sum = _mm_mul_ps(c[0], _mm_loadu_ps(st.odd + m));
+        for (int g = 1; g < groups; ++g) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(c[g], _mm_loadu_ps(st.odd + m + g * 4)));
+        }
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        out[m] = _mm_cvtss_f32(sum) + 0.5f * st.even[m];
+    }
+    memmove(st.odd, st.odd + out_count, odd_history * sizeof(float));
+    memmove(st.even, st.even + out_count, even_history * sizeof(float));
+}
+#endif
+
+static SubsampleFn select_subsample_kernel() {
+#ifdef LEDC_SIM_X86_KERNELS
+    if (__builtin_cpu_supports("sse2")) return generate_subsamples_sse2;
+#endif
+    return generate_subsamples_scalar;
+}
+
+static HalfbandFn select_halfband_kernel() {
+#ifdef LEDC_SIM_X86_KERNELS
+    if (__builtin_cpu_supports("sse2")) return halfband_sse2;
+#endif
+    return halfband_scalar;
+}
+
+static SubsampleFn g_generate_subsamples = select_subsample_kernel();
+static HalfbandFn g_halfband = select_halfband_kernel();
+
+// CIC 抽取：N 级积分器在高采样率下运行，N 级梳状器在抽取后运行，整数运算没有舍入误差
+static void cic_decimate(OversampleState& os, uint32_t in_count, float scale) {
+    uint32_t i0 = os.integrator[0], i1 = os.integrator[1], i2 = os.integrator[2], i3 = os.integrator[3];
+    for (uint32_t q = 0; q < in_count / CIC_DECIMATION; ++q) {
+        const int32_t* x = os.sub + q * CIC_DECIMATION;
+        for (int k = 0; k < CIC_DECIMATION; ++k) {
+            i0 += (uint32_t)x[k];
+            i1 += i0;
+            i2 += i1;
+            i3 += i2;
+        }
+        uint32_t y = i3;
+        for (int s = 0; s < CIC_ORDER; ++s) {
+            uint32_t prev = os.comb_delay[s];
+            os.comb_delay[s] = y;
+            y -= prev;
+        }
+        os.cic_out[q] = (float)(int32_t)y * scale;
+    }
+    os.integrator[0] = i0;
+    os.integrator[1] = i1;
+    os.integrator[2] = i2;
+    os.integrator[3] = i3;
+}
+
+// 渲染过采样通道并叠加到混合缓冲区。滤波链的延迟已经等于 BLEP_HALF_TAPS，
+// 所以第 n 帧的输出直接写到 mix[n]，与其他通道写入 mix[n + BLEP_HALF_TAPS] 的信号对齐
+static void mix_oversampled(OversampleState& os, float* mix, uint32_t frames) {
+    const uint32_t subsamples = frames * OVERSAMPLE_FACTOR;
+    const float scale = CHANNEL_AMPLITUDE / ((float)CIC_GAIN * OVERSAMPLE_LEVEL_ONE);
+    if (os.active_mask) {
+        g_generate_subsamples(os, frames);
+    } else {
+        memset(os.sub, 0, subsamples * sizeof(int32_t));
+    }
+    cic_decimate(os, subsamples, scale);
+    g_halfband(os.halfband1, g_halfband1_coeff, HALFBAND1_HALF, os.cic_out, frames * 2, os.halfband1_out);
+    g_halfband(os.halfband2, g_halfband2_coeff, HALFBAND2_HALF, os.halfband1_out, frames, os.halfband2_out);
+    for (uint32_t n = 0; n < frames; ++n) mix[n] += os.halfband2_out[n];
+
+    if (os.active_mask == 0) {
+        os.tail_frames = os.tail_frames > frames ? os.tail_frames - frames : 0;
+        if (os.tail_frames == 0) reset_oversample_filters(os); // 滤波链输出已归零，清掉积分器里的常数
+    }
+}
+
+// 输出端隔直滤波器：一阶高通，截止频率约 10Hz。
+// y[n] = x[n] - x[n-1] + DC_BLOCK_POLE * y[n-1]
+#define DC_BLOCK_POLE 0.99869f
+
+struct DcBlocker {
+    float x1;
+    float y1;
+};
+
+static DcBlocker g_dc_blocker = { 0.0f, 0.0f };
+
+static void dc_block(DcBlocker& st, float* buf, uint32_t frames) {
+    float x1 = st.x1, y1 = st.y1;
+    for (uint32_t i = 0; i < frames; ++i) {
+        float x = buf[i];
+        y1 = x - x1 + DC_BLOCK_POLE * y1;
+        x1 = x;
+        buf[i] = y1;
+    }
+    st.x1 = x1;
+    st.y1 = y1;
+}
+
+// 混合缓冲区中延续的残差和隔直滤波器状态都已归零时，后续输出必然是静音
+static bool render_tail_silent() {
+    if (g_oversample.tail_frames != 0) return false;
+    if (std::fabs(g_dc_blocker.y1) > 1e-7f || std::fabs(g_dc_blocker.x1) > 1e-7f) return false;
+    for (int i = 0; i < 2 * BLEP_HALF_TAPS; ++i) {
+        if (g_mix_buffer[i] != 0.0f) return false;
+    }
+    g_dc_blocker.x1 = g_dc_blocker.y1 = 0.0f;
+    return true;
+}
+
+// 将混合缓冲区前 frames 帧输出，并把尾部残差移到缓冲区开头供下一块使用
+static void flush_mix_buffer(float* mix, float* out, uint32_t frames) {
+    memcpy(out, mix, frames * sizeof(float));
+    memmove(mix, mix + frames, 2 * BLEP_HALF_TAPS * sizeof(float));
+    memset(mix + 2 * BLEP_HALF_TAPS, 0, frames * sizeof(float));
+}
+
+// --- HAL -> 音频线程命令队列 ---
+// 每个 ledc* 调用把一次完整的修改打包成一条命令（例如 ledcWriteTone 同时携带频率和占空比），
+// 音频线程在每个周期开始时一次性取出，应用到自己私有的、非原子的通道副本上。
+// 因此回调不会看到"新频率 + 旧占空比"这样的撕裂状态，混音循环中也没有任何原子操作。
+//
+// 队列是有界的多生产者单消费者环形缓冲区：生产者用一次 fetch_add 领取槽位（无等待），
+// 写入命令后通过槽位序号发布；消费者按序号顺序读取，遇到尚未发布的槽位就停下，留到下个周期。
+// 只有在一个周期内积压超过 LEDC_COMMAND_RING_SIZE 条命令时，生产者才需要让出 CPU 等待音频线程。
+#define LEDC_COMMAND_RING_SIZE 4096 // 必须是 2 的幂
+
+enum LedcCommandType {
+    LEDC_CMD_ATTACH,  // 附加通道：定时器配置，占空比清零
+    LEDC_CMD_DETACH,  // 分离通道
+    LEDC_CMD_TIMER,   // 修改定时器（频率/分辨率），占空比不变
+    LEDC_CMD_DUTY,    // 修改占空比
+    LEDC_CMD_TONE,    // 同时修改定时器与占空比
+    LEDC_CMD_SEQUENCE, // 开始播放一串音符（见下文"音符序列"）
+    LEDC_CMD_SWEEP,   // 开始频率扫描（见下文"频率扫描"）
+    LEDC_CMD_MODULATION, // 设置通道的 LFO 调制（见下文"LFO 调制"）
+    LEDC_CMD_FADE,    // 从 duty 开始的占空比渐变（见下文"占空比渐变"）
+};
+
+struct LedcSequence;
+
+struct LedcCommand {
+    uint8_t type;
+    uint8_t channel;
+    uint8_t resolution;
+    bool above_nyquist;
+    uint32_t phase_increment;
+    uint32_t duty;
+    uint32_t gate_serial;  // 非 0 表示门控音符（见下文"门控音符"）
+    uint32_t gate_frames;  // 门控音符的时长（帧），0 表示一直播放到下一个音符
+    LedcSequence* sequence; // LEDC_CMD_SEQUENCE 要播放的序列
+    bool cancel_gates;     // 同时丢弃该通道尚未开始的门控音符和序列
+    bool sweep_exponential;
+    double sweep_increment; // 扫描第一个子块的相位增量
+    double sweep_rate;      // 每个子块相位增量的增加值（线性）或倍数（指数）
+    uint8_t lfo_waveform;
+    uint32_t lfo_increment; // 每个调制子块的 LFO 相位增量，0 表示关闭调制
+    float lfo_depth;        // 调制深度（八度）
+    uint32_t fade_target;   // 渐变的目标占空比
+    uint32_t fade_frames;   // 渐变时长（帧）
+    uint32_t fade_serial;   // 渐变序号，结束时随完成事件送给中断分发线程
+    uint64_t timestamp_ns; // HAL 调用发生的单调时钟时间，由 push_command 填写
+};
+
+static LedcCommand make_command(uint8_t type, uint8_t channel) {
+    LedcCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = type;
+    cmd.channel = channel;
+    return cmd;
+}
+
+// 命令时间戳使用模拟时钟：实时模式下即单调时钟，虚拟时间模式下为模拟时间
+static uint64_t monotonic_now_ns() {
+    return simClockNowNs();
+}
+
+struct LedcCommandSlot {
+    std::atomic<uint32_t> sequence; // 等于领取位置时可写，等于位置 + 1 时可读
+    LedcCommand cmd;
+};
+
+static LedcCommandSlot g_command_ring[LEDC_COMMAND_RING_SIZE];
+static std::atomic<uint32_t> g_command_head(0); // 生产者领取位置
+static uint32_t g_command_tail = 0;             // 消费者读取位置，仅由音频线程访问
+
+static void init_command_ring() {
+    for (uint32_t i = 0; i < LEDC_COMMAND_RING_SIZE; ++i) {
+        g_command_ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    g_command_head.store(0, std::memory_order_relaxed);
+    g_command_tail = 0;
+}
+
+// ledcSimScheduleAt 设置的生效时间，0 表示立即生效
+static thread_local uint64_t t_schedule_time_ns = 0;
+
+static void push_command(LedcCommand cmd) {
+    // 没有音频线程消费命令；虚拟时间模式下由延时的线程渲染并消费
+    if (!g_audio_initialized && simClockGetMode() != SIM_CLOCK_VIRTUAL) return;
+    cmd.timestamp_ns = t_schedule_time_ns != 0 ? t_schedule_time_ns : monotonic_now_ns();
+    uint32_t pos = g_command_head.fetch_add(1, std::memory_order_relaxed);
+    LedcCommandSlot& slot = g_command_ring[pos & (LEDC_COMMAND_RING_SIZE - 1)];
+    while (slot.sequence.load(std::memory_order_acquire) != pos) {
+        std::this_thread::yield(); // 队列已满，等待音频线程取走旧命令
+    }
+    slot.cmd = cmd;
+    slot.sequence.store(pos + 1, std::memory_order_release);
+}
+
+// 音频线程私有的通道副本
+struct LedcVoice {
+    bool attached;
+    uint8_t resolution;
+    bool above_nyquist;
+    uint32_t phase_increment;
+    uint32_t duty;
+    uint32_t gate_serial;  // 正在播放的门控音符，0 表示没有
+    uint64_t gate_end;     // 门控音符结束的帧号，0 表示不限时长
+    LedcSequence* sequence; // 正在播放的序列，gate_end 为当前一步结束的帧号
+    uint32_t seq_index;     // 当前音符
+    bool seq_in_gap;        // 处于音符之后的间隔中
+    uint32_t seq_loops_left; // 剩余播放次数，0 表示无限循环
+    bool sweep;             // 正在频率扫描，gate_end 为当前子块结束的帧号
+    bool sweep_exponential;
+    double sweep_increment;
+    double sweep_rate;
+    uint64_t sweep_end;     // 扫描结束的帧号
+    uint8_t lfo_waveform;
+    uint32_t lfo_phase;
+    uint32_t lfo_increment; // 0 表示没有调制
+    float lfo_depth;
+    float mod_factor;       // 当前子块的频率倍数
+    uint32_t fade_from;     // 渐变的起点占空比
+    uint32_t fade_target;
+    uint64_t fade_start;    // 渐变开始和结束的帧号
+    uint64_t fade_end;
+    uint32_t fade_serial;
+    bool samples;           // sequence 是 PWM-DAC 采样块（见下文"PWM-DAC 采样流"）
+    uint32_t sample_index;  // 当前的采样
+    uint64_t sample_origin; // 采样块开始的帧号
+    uint64_t sample_next;   // 下一个采样相对 sample_origin 的位置（帧，32.32 定点）
+};
+
+static LedcVoice g_voices[NUM_LEDC_CHANNELS];
+static uint64_t g_render_frame = 0;  // 已渲染的输出帧数，即下一帧的帧号
+static int g_render_lanes = 0; // 需要混音的通道数（最高发声通道 + 1）
+static double g_render_edge_rate = 0.0; // 所有通道平均每个采样的跳变沿数
+
+// 基频高于奈奎斯特频率的通道（超声载波）。固定频率和占空比的 PWM 只在基频及其整数倍上有能量，
+// 全部位于音频带外，带内只剩平均电平 gain * (2 * 占空比 - 1)。这类通道不进入任何逐采样渲染器，
+// 只把平均电平按常数整段累加；平均电平改变时（占空比变化、附加/分离）叠加一个带限阶跃，
+// 占空比调制产生的带内分量因此仍然保留。模拟的定时器没有分频抖动，不会产生其他次谐波。
+static float g_ultrasonic_level[NUM_LEDC_CHANNELS]; // 各通道的平均电平
+static float g_ultrasonic_total = 0.0f;             // 所有超声通道平均电平之和
+static float g_ultrasonic_step = 0.0f;              // 尚未叠加 BLEP 的电平变化
+static uint32_t g_ultrasonic_mask = 0;              // 以平均电平渲染的通道
+
+static void set_ultrasonic_level(int ch, bool ultrasonic, float level) {
+    g_ultrasonic_step += level - g_ultrasonic_level[ch];
+    g_ultrasonic_level[ch] = level;
+    if (ultrasonic) {
+        g_ultrasonic_mask |= 1u << ch;
+    } else {
+        g_ultrasonic_mask &= ~(1u << ch);
+    }
+    g_ultrasonic_total = 0.0f;
+    for (uint32_t bits = g_ultrasonic_mask; bits; bits &= bits - 1) {
+        g_ultrasonic_total += g_ultrasonic_level[__builtin_ctz(bits)];
+    }
+}
+
+// 正在播放 PWM-DAC 采样块的通道（见下文"PWM-DAC 采样流"）。超声载波的通道仍按平均电平渲染，
+// 但电平在段内每个采样的精确位置改变；载波可闻的通道在采样所在的帧切换占空比
+static uint32_t g_sample_mask = 0;                 // 超声载波，段内逐采样叠加电平阶跃
+static uint32_t g_sample_slow_mask = 0;            // 可闻载波，按帧切换占空比
+static uint64_t g_next_sample_frame = ~(uint64_t)0; // 可闻载波通道下一个采样生效的帧号
+static void update_next_sample_frame();
+static void mix_sample_lanes(float* mix, uint32_t frames, int mode);
+
+// --- LFO 调制 ---
+// 颤音 / 警笛式的频率调制在音频线程内完成：每个通道一个查表 LFO，
+// 每 MOD_BLOCK_FRAMES 帧取一次 LFO 值，把通道的相位增量乘以 2^(depth * lfo)。
+// 调制只改变渲染用的增量，通道本身的频率不变，与 ledcWriteTone、序列和频率扫描可以叠加。
+#define MOD_BLOCK_FRAMES 16
+#define LFO_TABLE_BITS 8
+#define LFO_TABLE_SIZE (1 << LFO_TABLE_BITS)
+#define LFO_WAVEFORMS 4
+
+static float g_lfo_table[LFO_WAVEFORMS][LFO_TABLE_SIZE + 1]; // 多一项便于线性插值
+static uint32_t g_mod_mask = 0;               // 打开调制的通道，仅由音频线程访问
+static uint64_t g_next_mod_frame = ~(uint64_t)0; // 下一次更新调制的帧号
+
+static void init_lfo_tables() {
+    for (int i = 0; i <= LFO_TABLE_SIZE; ++i) {
+        double t = (double)(i % LFO_TABLE_SIZE) / LFO_TABLE_SIZE;
+        g_lfo_table[LEDC_SIM_LFO_SINE][i] = (float)std::sin(2.0 * M_PI * t);
+        g_lfo_table[LEDC_SIM_LFO_TRIANGLE][i] = (float)(t < 0.25 ? 4.0 * t : t < 0.75 ? 2.0 - 4.0 * t : 4.0 * t - 4.0);
+        g_lfo_table[LEDC_SIM_LFO_SQUARE][i] = t < 0.5 ? 1.0f : -1.0f;
+        g_lfo_table[LEDC_SIM_LFO_SAWTOOTH][i] = (float)(2.0 * t - 1.0);
+    }
+    // 方波在表的两端不插值，避免跳变处出现斜坡
+    g_lfo_table[LEDC_SIM_LFO_SQUARE][LFO_TABLE_SIZE] = 1.0f;
+}
+
+static float lfo_value(uint8_t waveform, uint32_t phase) {
+    uint32_t index = phase >> (32 - LFO_TABLE_BITS);
+    if (waveform == LEDC_SIM_LFO_SQUARE) return g_lfo_table[waveform][index];
+    float frac = (float)(phase & ((1u << (32 - LFO_TABLE_BITS)) - 1)) * (1.0f / (1u << (32 - LFO_TABLE_BITS)));
+    const float* table = g_lfo_table[waveform];
+    return table[index] + (table[index + 1] - table[index]) * frac;
+}
+
+// 渲染用的相位增量：通道增量乘以当前的调制倍数
+static uint32_t voice_increment(const LedcVoice& v, bool* above_nyquist) {
+    *above_nyquist = v.above_nyquist;
+    if (v.lfo_increment == 0 || v.above_nyquist) return v.phase_increment;
+    double inc = (double)v.phase_increment * v.mod_factor;
+    *above_nyquist = inc > 2147483648.0;
+    return *above_nyquist ? 0 : (uint32_t)inc;
+}
+
+// 根据通道副本刷新 SoA 渲染参数。
+// 与 LEDC 硬件一样，计数器低于占空比时输出高电平：占空比 / 2^resolution 在这里一次性换算成
+// 相位阈值 duty << (32 - resolution)，混音循环只做比较，不做除法。
+// 高电平为 +gain、低电平为 -gain，每个周期固定两个跳变沿，渲染开销与占空比无关；
+// 非 50% 占空比带来的直流分量由输出端的隔直滤波器去除（与蜂鸣器的交流耦合一致）。
+static void update_render_lane(int ch) {
+    const LedcVoice& v = g_voices[ch];
+    bool above_nyquist;
+    uint32_t increment = voice_increment(v, &above_nyquist);
+    // 超声通道的相位增量可能恰好回绕成 0，但它仍在输出平均电平。
+    // PWM-DAC 采样为 0 是满幅的低电平，不是静音
+    bool sounding = v.attached && (v.duty != 0 || v.samples) && (increment != 0 || above_nyquist);
+    uint32_t full_scale = 1u << v.resolution;
+    uint32_t threshold = 0;
+    if (sounding) {
+        threshold = v.duty >= full_scale ? 0xFFFFFFFFu // 100% 占空比：持续高电平
+                                         : v.duty << (32 - v.resolution);
+    }
+    bool ultrasonic = sounding && above_nyquist;
+    float duty_ratio = v.duty >= full_scale ? 1.0f : (float)v.duty / (float)full_scale;
+    set_ultrasonic_level(ch, ultrasonic, ultrasonic ? CHANNEL_AMPLITUDE * (2.0f * duty_ratio - 1.0f) : 0.0f);
+    if (v.samples && ultrasonic) {
+        g_sample_mask |= 1u << ch;
+    } else {
+        g_sample_mask &= ~(1u << ch);
+    }
+    if (v.samples && !ultrasonic) {
+        g_sample_slow_mask |= 1u << ch;
+    } else {
+        g_sample_slow_mask &= ~(1u << ch);
+    }
+    update_next_sample_frame();
+    if (ultrasonic) sounding = false;
+    // 过采样通道在 g_render 中保持静音，由过采样渲染器负责
+    bool oversampled = (g_oversample_lanes >> ch) & 1;
+    set_oversample_lane(g_oversample, ch, sounding && oversampled ? increment : 0, threshold);
+    if (oversampled) sounding = false;
+    g_render.increment[ch] = sounding ? increment : 0;
+    g_render.threshold[ch] = sounding ? threshold : 0;
+    g_render.gain[ch] = sounding ? CHANNEL_AMPLITUDE : 0.0f;
+
+    if (sounding) {
+        g_render.active_mask |= 1u << ch;
+    } else {
+        g_render.active_mask &= ~(1u << ch);
+    }
+    g_render_lanes = g_render.active_mask ? 32 - __builtin_clz(g_render.active_mask) : 0;
+    g_render_edge_rate = 0.0;
+    for (uint32_t bits = g_render.active_mask; bits; bits &= bits - 1) {
+        g_render_edge_rate += 2.0 * g_render.increment[__builtin_ctz(bits)] / 4294967296.0;
+    }
+}
+
+// 采用模拟器接口设置的过采样位图，在两个渲染器之间移交通道时保留相位
+static void sync_oversample_lanes() {
+    uint32_t requested = g_oversample_request.load(std::memory_order_relaxed);
+    uint32_t changed = requested ^ g_oversample_lanes;
+    if (changed == 0) return;
+    g_oversample_lanes = requested;
+    for (uint32_t bits = changed; bits; bits &= bits - 1) {
+        int ch = __builtin_ctz(bits);
+        if ((requested >> ch) & 1) {
+            g_oversample.phase[ch] = g_render.phase[ch];
+        } else {
+            g_render.phase[ch] = g_oversample.phase[ch];
+        }
+        update_render_lane(ch);
+    }
+}
+
+// 按渲染模式选择逐采样内核或跳变沿列表，过采样通道另行渲染
+static void mix_segment(float* mix, uint32_t frames, int mode) {
+    sync_oversample_lanes();
+    if (g_render_lanes > 0) {
+        int render_mode = g_render_mode.load(std::memory_order_relaxed);
+        bool edge_list = render_mode == LEDC_SIM_RENDER_EDGE_LIST ||
+                         (render_mode == LEDC_SIM_RENDER_AUTO && g_render_edge_rate < EDGE_LIST_MAX_DENSITY);
+        if (edge_list) {
+            mix_edge_list(g_render, g_render_lanes, mix, frames, mode);
+        } else {
+            g_mix_kernel(g_render, g_render_lanes, mix, frames, mode);
+        }
+    }
+    if (g_oversample.active_mask || g_oversample.tail_frames) {
+        mix_oversampled(g_oversample, mix, frames);
+    }
+    // 超声通道：电平变化发生在本段第一帧，即上一帧之后 frac = 1 处
+    if (g_ultrasonic_step != 0.0f) {
+        if (mode != LEDC_SIM_OSC_NAIVE) add_blep(mix, 1.0f, g_ultrasonic_step, mode);
+        g_ultrasonic_step = 0.0f;
+    }
+    if (g_ultrasonic_mask) {
+        g_add_constant_run(mix + BLEP_HALF_TAPS, frames, g_ultrasonic_total);
+    }
+    if (g_sample_mask) mix_sample_lanes(mix, frames, mode);
+}
+
+// --- 音符序列 ---
+// 一整串音符在提交时一次性换算成定时器参数和帧数，交给音频线程后按帧逐步切换，
+// 期间不再需要调用线程参与。序列占用通道的门控音符位置：当前一步的结束帧就是 gate_end，
+// 整个序列播完、被取消或被通道上的其他命令取代时才作为一个音符结束。
+// 音频线程不释放内存，用完的序列经由回收环交还给 HAL 一侧删除。
+// 每一步与编译期旋律表（ledc_melody.h）使用同一个结构，编译好的旋律不经换算、不复制，直接交给音频线程。
+typedef ledc_sim_melody_step_t LedcSequenceStep;
+
+struct LedcSequence {
+    uint8_t resolution;
+    uint32_t repeat;     // 播放次数，0 表示无限循环
+    uint64_t total_frames; // 播放一遍的帧数
+    const LedcSequenceStep* steps; // 指向 storage，或指向调用者保证一直有效的静态旋律表
+    uint32_t step_count;
+    std::vector<LedcSequenceStep> storage;
+    std::vector<uint32_t> samples; // 不为空时是 PWM-DAC 采样块，没有音符（见下文"PWM-DAC 采样流"）
+    uint64_t sample_step;          // 每个采样的帧数，32.32 定点
+    uint32_t sample_offset;        // 第一个采样在起始帧之后的理想起点（帧的小数部分，0.32 定点）
+};
+
+#define LEDC_SEQUENCE_RETIRE_SIZE 256 // 必须是 2 的幂
+static LedcSequence* g_sequence_retired[LEDC_SEQUENCE_RETIRE_SIZE];
+static std::atomic<uint32_t> g_sequence_retire_head(0); // 仅由持有 g_render_mutex 的线程推进
+static std::atomic<uint32_t> g_sequence_retire_tail(0); // 仅由持有 g_sequence_mutex 的线程推进
+static std::mutex g_sequence_mutex;
+
+static void retire_sequence(LedcSequence* seq) {
+    uint32_t head = g_sequence_retire_head.load(std::memory_order_relaxed);
+    if (head - g_sequence_retire_tail.load(std::memory_order_acquire) == LEDC_SEQUENCE_RETIRE_SIZE) {
+        return; // 回收环已满（HAL 一侧很久没有调用），宁可泄漏也不在音频线程中释放
+    }
+    g_sequence_retired[head & (LEDC_SEQUENCE_RETIRE_SIZE - 1)] = seq;
+    g_sequence_retire_head.store(head + 1, std::memory_order_release);
+}
+
+// 删除音频线程已用完的序列，在 HAL 一侧调用
+static void collect_retired_sequences() {
+    std::lock_guard<std::mutex> lock(g_sequence_mutex);
+    uint32_t tail = g_sequence_retire_tail.load(std::memory_order_relaxed);
+    uint32_t head = g_sequence_retire_head.load(std::memory_order_acquire);
+    while (tail != head) {
+        delete g_sequence_retired[tail & (LEDC_SEQUENCE_RETIRE_SIZE - 1)];
+        ++tail;
+    }
+    g_sequence_retire_tail.store(tail, std::memory_order_release);
+}
+
+// 前进到序列的下一步（音符 -> 间隔 -> 下一个音符），整个序列播完时返回 false
+static bool sequence_advance(LedcVoice& v) {
+    if (!v.seq_in_gap) {
+        v.seq_in_gap = true;
+        return true;
+    }
+    v.seq_in_gap = false;
+    if (++v.seq_index < v.sequence->step_count) return true;
+    v.seq_index = 0;
+    if (v.seq_loops_left == 0) return true;
+    return --v.seq_loops_left > 0;
+}
+
+// 从当前一步开始输出，跳过长度为 0 的步骤；序列已播完时返回 false
+static bool sequence_enter(LedcVoice& v, uint64_t frame) {
+    for (;;) {
+        const LedcSequenceStep& step = v.sequence->steps[v.seq_index];
+        uint32_t frames = v.seq_in_gap ? step.gap_frames : step.note_frames;
+        if (frames > 0) {
+            v.phase_increment = step.phase_increment;
+            v.above_nyquist = step.above_nyquist;
+            v.duty = v.seq_in_gap ? 0 : step.duty;
+            v.gate_end = frame + frames;
+            return true;
+        }
+        if (!sequence_advance(v)) return false; // 提交时已保证一遍的总长度不为 0
+    }
+}
+
+// --- 频率扫描 ---
+// 扫描也占用通道的门控音符位置，每 SWEEP_BLOCK_FRAMES 帧更新一次相位增量（取子块中点的频率），
+// 相位连续，相邻子块的频率差远小于可闻阈值，听起来与逐采样更新没有区别，
+// 而混音内核仍然按常数增量处理每个子块。线性扫描每块加一个常数，指数扫描每块乘一个常数，
+// 音频线程里只有一次加法或乘法。扫描的频率是连续的，不经过 LEDC 分频系数的量化。
+#define SWEEP_BLOCK_FRAMES 16
+
+static void sweep_apply_increment(LedcVoice& v) {
+    double inc = v.sweep_increment;
+    v.above_nyquist = inc > 2147483648.0;
+    v.phase_increment = inc < 4294967296.0 ? (uint32_t)inc : 0xFFFFFFFFu;
+}
+
+// 进入下一个子块，扫描结束时返回 false
+static bool sweep_advance(LedcVoice& v) {
+    if (v.gate_end >= v.sweep_end) return false;
+    if (v.sweep_exponential) {
+        v.sweep_increment *= v.sweep_rate;
+    } else {
+        v.sweep_increment += v.sweep_rate;
+    }
+    sweep_apply_increment(v);
+    v.gate_end = std::min(v.gate_end + SWEEP_BLOCK_FRAMES, v.sweep_end);
+    return true;
+}
+
+// --- PWM-DAC 采样流 ---
+// 用定时器中断以 8-16kHz 调用 ledcWrite 播放语音的板子，本质上是把 PCM 采样逐个写成占空比。
+// 逐个提交命令既占满命令队列，也会让每个采样切开一次渲染循环，所以 ledcSimWriteSamples 把一整块采样
+// 放进一个序列（LedcSequence::samples）交给音频线程，采样块按门控音符排队，连续提交的块首尾相接。
+// 载波高于奈奎斯特频率时（PWM-DAC 的常规做法），低通滤波后的输出就是占空比决定的平均电平：
+// 通道保留在超声路径上，mix_sample_lanes 在每个采样的精确时刻（帧内的小数位置）叠加一个带限阶跃，
+// 相当于对零阶保持的输出做带限重建，采样率不必整除 SIM 采样率。
+// 载波可闻时没有这样的简化，采样在最接近的帧切换占空比，渲染循环在这些帧处切分。
+
+// 采样对应的平均电平，与 update_render_lane 中超声通道的电平相同
+static float sample_level(uint32_t duty, uint8_t resolution) {
+    uint32_t full_scale = 1u << resolution;
+    float duty_ratio = duty >= full_scale ? 1.0f : (float)duty / (float)full_scale;
+    return CHANNEL_AMPLITUDE * (2.0f * duty_ratio - 1.0f);
+}
+
+// 可闻载波的通道中，下一个采样在哪一帧生效（四舍五入到帧）
+static void update_next_sample_frame() {
+    g_next_sample_frame = ~(uint64_t)0;
+    for (uint32_t bits = g_sample_slow_mask; bits; bits &= bits - 1) {
+        const LedcVoice& v = g_voices[__builtin_ctz(bits)];
+        if (v.samples && v.sample_index + 1 < v.sequence->samples.size()) {
+            g_next_sample_frame = std::min(g_next_sample_frame, v.sample_origin + ((v.sample_next + 0x80000000u) >> 32));
+        }
+    }
+}
+
+// 可闻载波的通道：切换到 frame 处应当生效的采样
+static void update_sample_lanes(uint64_t frame) {
+    for (uint32_t bits = g_sample_slow_mask; bits; bits &= bits - 1) {
+        int ch = __builtin_ctz(bits);
+        LedcVoice& v = g_voices[ch];
+        if (!v.samples) continue; // 采样块刚结束，渲染参数还没有刷新
+        const LedcSequence& seq = *v.sequence;
+        bool changed = false;
+        while (v.sample_index + 1 < seq.samples.size() && v.sample_origin + ((v.sample_next + 0x80000000u) >> 32) <= frame) {
+            ++v.sample_index;
+            v.sample_next += seq.sample_step;
+            changed = true;
+        }
+        if (changed) {
+            v.duty = seq.samples[v.sample_index];
+            update_render_lane(ch);
+        }
+    }
+    update_next_sample_frame();
+}
+
+// 超声载波的通道：段内每个采样在它的小数位置改变电平。段开头的电平已经包含在 g_ultrasonic_total 中，
+// 这里只叠加之后的变化量和阶跃残差，最后把段末的电平记回超声电平，不再产生阶跃
+static void mix_sample_lanes(float* mix, uint32_t frames, int mode) {
+    for (uint32_t bits = g_sample_mask; bits; bits &= bits - 1) {
+        int ch = __builtin_ctz(bits);
+        LedcVoice& v = g_voices[ch];
+        const LedcSequence& seq = *v.sequence;
+        uint64_t segment_start = g_render_frame - v.sample_origin;
+        uint64_t segment_end = (segment_start + frames) << 32;
+        float base = g_ultrasonic_level[ch];
+        float level = base;
+        uint32_t run_start = 0;
+        while (v.sample_index + 1 < seq.samples.size() && v.sample_next < segment_end) {
+            uint32_t n = (uint32_t)((v.sample_next >> 32) - segment_start);
+            float frac = (float)(uint32_t)v.sample_next * (1.0f / 4294967296.0f);
+            // 采样恰好落在第 n 帧上时从第 n 帧生效，否则从第 n + 1 帧生效（add_blep 的 frac 取 (0, 1]）
+            uint32_t switch_frame = frac == 0.0f ? n : n + 1;
+            if (level != base) g_add_constant_run(mix + BLEP_HALF_TAPS + run_start, switch_frame - run_start, level - base);
+            run_start = switch_frame;
+            ++v.sample_index;
+            v.sample_next += seq.sample_step;
+            float next = sample_level(seq.samples[v.sample_index], v.resolution);
+            if (mode != LEDC_SIM_OSC_NAIVE && next != level) {
+                add_blep(mix + switch_frame, frac == 0.0f ? 1.0f : frac, next - level, mode);
+            }
+            level = next;
+        }
+        v.duty = seq.samples[v.sample_index];
+        if (level != base) {
+            g_add_constant_run(mix + BLEP_HALF_TAPS + run_start, frames - run_start, level - base);
+            g_ultrasonic_total += level - base;
+            g_ultrasonic_level[ch] = level;
+        }
+    }
+}
+
+// --- 占空比渐变 ---
+// ledcFade 的渐变由音频线程计算：调用线程只提交一条命令，渲染器与 LFO 共用调制子块，
+// 每 MOD_BLOCK_FRAMES 帧按线性插值更新一次占空比，在结束的那一帧精确地设为目标值。
+// 渐变结束（完成或被通道上的其他命令取消）时音频线程把完成事件放进单生产者单消费者的环形缓冲区，
+// 由独立的中断分发线程调用用户的回调，与真机上回调在 LEDC 中断里执行一样，不占用音频线程。
+#define LEDC_FADE_EVENT_RING_SIZE 64 // 必须是 2 的幂
+
+struct LedcFadeEvent {
+    uint8_t channel;
+    bool completed; // false 表示渐变被取消，不调用回调
+    uint32_t serial;
+};
+
+static LedcFadeEvent g_fade_events[LEDC_FADE_EVENT_RING_SIZE];
+static std::atomic<uint32_t> g_fade_event_head(0); // 仅由持有 g_render_mutex 的线程推进
+static std::atomic<uint32_t> g_fade_event_tail(0); // 仅由中断分发线程推进
+static bool g_fade_event_posted = false;           // 本次渲染发布了事件，受 g_render_mutex 保护
+static std::atomic<SimClockWaiter*> g_fade_isr_waiter(nullptr); // 中断分发线程等待的对象，线程启动后才有
+static uint32_t g_fade_mask = 0;                   // 正在渐变的通道，仅由音频线程访问
+
+// 结束通道上的渐变并发布事件，不改变当前占空比
+static void finish_fade(int ch, bool completed) {
+    if (!((g_fade_mask >> ch) & 1)) return;
+    g_fade_mask &= ~(1u << ch);
+    uint32_t head = g_fade_event_head.load(std::memory_order_relaxed);
+    if (head - g_fade_event_tail.load(std::memory_order_acquire) == LEDC_FADE_EVENT_RING_SIZE) return; // 分发线程跟不上，丢弃
+    LedcFadeEvent& ev = g_fade_events[head & (LEDC_FADE_EVENT_RING_SIZE - 1)];
+    ev.channel = (uint8_t)ch;
+    ev.completed = completed;
+    ev.serial = g_voices[ch].fade_serial;
+    g_fade_event_head.store(head + 1, std::memory_order_release);
+    g_fade_event_posted = true;
+}
+
+// 下一个子块边界或渐变结束的帧
+static void update_next_mod_frame(uint64_t frame) {
+    uint64_t next = (g_mod_mask || g_fade_mask) ? (frame / MOD_BLOCK_FRAMES + 1) * MOD_BLOCK_FRAMES : ~(uint64_t)0;
+    for (uint32_t bits = g_fade_mask; bits; bits &= bits - 1) {
+        next = std::min(next, g_voices[__builtin_ctz(bits)].fade_end);
+    }
+    g_next_mod_frame = next;
+}
+
+// 渐变在 frame 处的占空比
+static uint32_t fade_duty_at(const LedcVoice& v, uint64_t frame) {
+    int64_t span = (int64_t)v.fade_target - (int64_t)v.fade_from;
+    return (uint32_t)((int64_t)v.fade_from + span * (int64_t)(frame - v.fade_start) / (int64_t)(v.fade_end - v.fade_start));
+}
+
+// 取 LFO 当前的值并前进一个子块
+static void step_lfo(LedcVoice& v) {
+    v.mod_factor = std::exp2(v.lfo_depth * lfo_value(v.lfo_waveform, v.lfo_phase));
+    v.lfo_phase += v.lfo_increment;
+}
+
+// 推进所有调制通道的 LFO 和渐变并刷新渲染参数，在子块边界和渐变结束的帧调用。
+// LFO 只在子块边界前进，渐变结束的帧不会改变 LFO 的速率
+static void update_modulation(uint64_t frame) {
+    if (frame % MOD_BLOCK_FRAMES == 0) {
+        for (uint32_t bits = g_mod_mask; bits; bits &= bits - 1) {
+            int ch = __builtin_ctz(bits);
+            step_lfo(g_voices[ch]);
+            update_render_lane(ch);
+        }
+    }
+    for (uint32_t bits = g_fade_mask; bits; bits &= bits - 1) {
+        int ch = __builtin_ctz(bits);
+        LedcVoice& v = g_voices[ch];
+        if (frame >= v.fade_end) {
+            v.duty = v.fade_target;
+            finish_fade(ch, true);
+        } else {
+            v.duty = fade_duty_at(v, frame);
+        }
+        update_render_lane(ch);
+    }
+    update_next_mod_frame(frame);
+}
+
+// --- 门控音符 ---
+// tone() 的时长由渲染器计时：门控音符携带帧数预算，渲染器在预算用完的那一帧把通道静音，
+// 不依赖任何线程的延时精度。同一通道上连续的门控音符首尾相接：后一个音符从前一个结束的帧开始，
+// 所以排队的音符之间没有缝隙，时长精确到帧。
+// 音符结束（时长用完、被下一个音符取代或通道分离）时音频线程发布它的序号，
+// 等待的线程通过条件变量被唤醒；没有线程等待时音频线程不加锁。
+static std::atomic<uint32_t> g_gate_serial_next[NUM_LEDC_CHANNELS]; // HAL 一侧分配的音符序号
+static std::atomic<uint32_t> g_gate_finished[NUM_LEDC_CHANNELS];    // 已结束的最大音符序号
+static uint64_t g_gate_tail[NUM_LEDC_CHANNELS]; // 最后一个门控音符结束的帧号，仅由音频线程访问
+static uint64_t g_next_gate_end = ~(uint64_t)0; // 所有通道中最早的门控结束帧
+static std::mutex g_gate_mutex;
+static std::condition_variable g_gate_cv;
+static std::atomic<int> g_gate_waiters(0);
+
+static inline bool gate_serial_reached(uint32_t finished, uint32_t serial) {
+    return (int32_t)(finished - serial) >= 0;
+}
+
+static void publish_gate_finished(int ch, uint32_t serial) {
+    if (serial == 0 || gate_serial_reached(g_gate_finished[ch].load(std::memory_order_relaxed), serial)) return;
+    g_gate_finished[ch].store(serial);
+    if (g_gate_waiters.load() > 0) {
+        // 等待者在检查条件和进入等待之间持有锁，这里加一次锁保证通知不会丢失
+        { std::lock_guard<std::mutex> lock(g_gate_mutex); }
+        g_gate_cv.notify_all();
+    }
+}
+
+static void update_next_gate_end() {
+    g_next_gate_end = ~(uint64_t)0;
+    for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+        if (g_voices[ch].gate_end != 0 && g_voices[ch].gate_end < g_next_gate_end) {
+            g_next_gate_end = g_voices[ch].gate_end;
+        }
+    }
+}
+
+// 结束通道上的门控音符或序列并唤醒等待者，不改变通道输出
+static void finish_gate(int ch) {
+    LedcVoice& v = g_voices[ch];
+    publish_gate_finished(ch, v.gate_serial);
+    if (v.sequence) {
+        retire_sequence(v.sequence);
+        v.sequence = nullptr;
+    }
+    v.samples = false;
+    v.sweep = false;
+    v.gate_serial = 0;
+    v.gate_end = 0;
+}
+
+// 把所有在 frame 之前用完预算的门控音符静音，序列和扫描则切换到下一步
+static void expire_gates(uint64_t frame) {
+    for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+        LedcVoice& v = g_voices[ch];
+        if (v.gate_end != 0 && v.gate_end <= frame) {
+            bool more = v.samples  ? false // 采样块播完
+                      : v.sequence ? sequence_advance(v) && sequence_enter(v, v.gate_end)
+                      : v.sweep    ? sweep_advance(v)
+                                   : false;
+            if (!more) {
+                v.duty = 0;
+                finish_fade(ch, false);
+                finish_gate(ch);
+            }
+            update_render_lane(ch);
+        }
+    }
+    update_next_gate_end();
+}
+
+static void apply_command(const LedcCommand& cmd) {
+    LedcVoice& v = g_voices[cmd.channel];
+    if (cmd.type != LEDC_CMD_TIMER && cmd.type != LEDC_CMD_MODULATION) {
+        finish_fade(cmd.channel, false); // 其他改变占空比的命令（包括新的渐变）取消正在进行的渐变
+    }
+    switch (cmd.type) {
+        case LEDC_CMD_ATTACH:
+            v.attached = true;
+            v.duty = 0;
+            v.resolution = cmd.resolution;
+            v.phase_increment = cmd.phase_increment;
+            v.above_nyquist = cmd.above_nyquist;
+            break;
+        case LEDC_CMD_DETACH:
+            v.attached = false;
+            v.duty = 0;
+            break;
+        case LEDC_CMD_TIMER:
+            v.resolution = cmd.resolution;
+            v.phase_increment = cmd.phase_increment;
+            v.above_nyquist = cmd.above_nyquist;
+            break;
+        case LEDC_CMD_DUTY:
+            v.duty = cmd.duty;
+            break;
+        case LEDC_CMD_TONE:
+            v.resolution = cmd.resolution;
+            v.phase_increment = cmd.phase_increment;
+            v.above_nyquist = cmd.above_nyquist;
+            v.duty = cmd.duty;
+            break;
+        case LEDC_CMD_SEQUENCE:
+            v.resolution = cmd.sequence->resolution;
+            break;
+        case LEDC_CMD_SWEEP:
+            v.resolution = cmd.resolution;
+            v.duty = cmd.duty;
+            break;
+        case LEDC_CMD_MODULATION:
+            v.lfo_waveform = cmd.lfo_waveform;
+            v.lfo_increment = cmd.lfo_increment;
+            v.lfo_depth = cmd.lfo_depth;
+            v.lfo_phase = 0;
+            v.mod_factor = 1.0f;
+            if (v.lfo_increment) {
+                g_mod_mask |= 1u << cmd.channel;
+                step_lfo(v); // 第一个子块从命令所在的帧开始
+            } else {
+                g_mod_mask &= ~(1u << cmd.channel);
+            }
+            update_next_mod_frame(g_render_frame);
+            update_render_lane(cmd.channel);
+            return; // 调制是通道的附加设置，不影响门控音符、序列、扫描和渐变
+        case LEDC_CMD_FADE:
+            v.fade_from = cmd.duty;
+            v.fade_target = cmd.fade_target;
+            v.fade_serial = cmd.fade_serial;
+            v.fade_start = g_render_frame;
+            v.fade_end = g_render_frame + cmd.fade_frames;
+            v.duty = cmd.duty;
+            g_fade_mask |= 1u << cmd.channel;
+            if (cmd.fade_frames == 0) {
+                v.duty = cmd.fade_target;
+                finish_fade(cmd.channel, true);
+            }
+            update_next_mod_frame(g_render_frame);
+            break;
+    }
+    if (cmd.gate_serial != 0) {
+        // 新音符取代同一通道上之前的所有音符
+        finish_gate(cmd.channel);
+        publish_gate_finished(cmd.channel, cmd.gate_serial - 1);
+        v.gate_serial = cmd.gate_serial;
+        v.gate_end = cmd.gate_frames ? g_render_frame + cmd.gate_frames : 0;
+        if (cmd.type == LEDC_CMD_SEQUENCE && !cmd.sequence->samples.empty()) {
+            // PWM-DAC 采样块：通道的定时器不变，第一个采样从这一帧开始
+            v.sequence = cmd.sequence;
+            v.samples = true;
+            v.sample_index = 0;
+            v.sample_origin = g_render_frame;
+            v.sample_next = cmd.sequence->sample_offset + cmd.sequence->sample_step;
+            v.duty = cmd.sequence->samples[0];
+        } else if (cmd.type == LEDC_CMD_SEQUENCE) {
+            v.sequence = cmd.sequence;
+            v.seq_index = 0;
+            v.seq_in_gap = false;
+            v.seq_loops_left = cmd.sequence->repeat;
+            sequence_enter(v, g_render_frame);
+        } else if (cmd.type == LEDC_CMD_SWEEP) {
+            v.sweep = true;
+            v.sweep_exponential = cmd.sweep_exponential;
+            v.sweep_increment = cmd.sweep_increment;
+            v.sweep_rate = cmd.sweep_rate;
+            v.sweep_end = v.gate_end;
+            v.gate_end = std::min(g_render_frame + SWEEP_BLOCK_FRAMES, v.sweep_end);
+            sweep_apply_increment(v);
+        }
+        update_next_gate_end();
+    } else if (cmd.type == LEDC_CMD_ATTACH || cmd.type == LEDC_CMD_DETACH || v.sequence || v.sweep) {
+        // 通道上的其他命令取消正在播放的序列或扫描
+        finish_gate(cmd.channel);
+        update_next_gate_end();
+    }
+    update_render_lane(cmd.channel);
+}
+
+// --- 采样级精确的事件时间线 ---
+// 命令不再在下一个周期开头统一生效，而是按时间戳换算成输出帧号，在周期内的对应位置生效。
+// 帧号与单调时钟之间的映射由每次回调的时间校准：回调触发时刻本身有抖动，
+// 所以只把测量误差的一小部分计入映射（一阶锁相环），事件之间的相对时间因此保持精确。
+// 为了让上一个周期内发生的调用仍然落在未来的帧上，整体再加一个设备周期的固定延迟。
+#define LEDC_PENDING_EVENTS LEDC_COMMAND_RING_SIZE
+#define CLOCK_SYNC_GAIN 0.02            // 每次回调修正的误差比例
+#define CLOCK_RESYNC_NS 100000000.0     // 误差超过 100ms（欠载、首次回调）时直接重新对齐
+
+struct LedcPendingEvent {
+    uint64_t frame; // 生效的绝对输出帧号
+    LedcCommand cmd;
+};
+
+static LedcPendingEvent g_pending_events[LEDC_PENDING_EVENTS]; // 按 frame 升序排列
+static uint32_t g_pending_count = 0;
+
+struct RenderClockSync {
+    bool valid;
+    double ref_time_ns;   // ref_frame 对应的单调时钟时间
+    uint64_t ref_frame;
+    uint32_t latency_frames;
+};
+
+static RenderClockSync g_clock_sync = { false, 0.0, 0, 0 };
+
+// 在回调开始时校准帧号与单调时钟的映射，frames 为本次回调的帧数
+static void sync_render_clock(uint64_t now_ns, uint32_t frames) {
+    RenderClockSync& sync = g_clock_sync;
+    if (frames > sync.latency_frames) sync.latency_frames = frames;
+    double predicted = sync.ref_time_ns + (double)(g_render_frame - sync.ref_frame) * 1e9 / SIM_SAMPLE_RATE;
+    double error = (double)now_ns - predicted;
+    if (!sync.valid || std::fabs(error) > CLOCK_RESYNC_NS) {
+        sync.ref_time_ns = (double)now_ns;
+        sync.valid = true;
+    } else {
+        sync.ref_time_ns = predicted + error * CLOCK_SYNC_GAIN;
+    }
+    sync.ref_frame = g_render_frame;
+}
+
+// 虚拟时间与帧号一一对应，没有抖动，也不需要额外延迟
+static uint64_t virtual_time_to_frame(uint64_t time_ns) {
+    return time_ns / 1000000000u * SIM_SAMPLE_RATE + time_ns % 1000000000u * SIM_SAMPLE_RATE / 1000000000u;
+}
+
+// 帧号对应的虚拟时间，向上取整，保证 virtual_time_to_frame 换算回来不早于 frame
+static uint64_t virtual_frame_to_time(uint64_t frame) {
+    return frame / SIM_SAMPLE_RATE * 1000000000u + (frame % SIM_SAMPLE_RATE * 1000000000u + SIM_SAMPLE_RATE - 1) / SIM_SAMPLE_RATE;
+}
+
+static uint64_t timestamp_to_frame(uint64_t timestamp_ns) {
+    if (simClockGetMode() == SIM_CLOCK_VIRTUAL) {
+        return virtual_time_to_frame(timestamp_ns);
+    }
+    const RenderClockSync& sync = g_clock_sync;
+    double offset = ((double)timestamp_ns - sync.ref_time_ns) * SIM_SAMPLE_RATE / 1e9 + sync.latency_frames;
+    if (offset <= 0.0) return sync.ref_frame;
+    return sync.ref_frame + (uint64_t)(offset + 0.5);
+}
+
+// 按帧号插入待处理事件；同一帧的事件保持到达顺序
+static void insert_pending_event(uint64_t frame, const LedcCommand& cmd) {
+    if (g_pending_count == LEDC_PENDING_EVENTS) {
+        apply_command(cmd); // 积压过多时退化为立即生效
+        return;
+    }
+    uint32_t i = g_pending_count++;
+    while (i > 0 && g_pending_events[i - 1].frame > frame) {
+        g_pending_events[i] = g_pending_events[i - 1];
+        --i;
+    }
+    g_pending_events[i].frame = frame;
+    g_pending_events[i].cmd = cmd;
+}
+
+// 分离通道时丢弃它尚未开始的门控音符，并把它们记为已结束
+static void cancel_pending_gates(uint8_t channel, uint64_t after_frame) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < g_pending_count; ++i) {
+        const LedcPendingEvent& ev = g_pending_events[i];
+        if (ev.cmd.channel == channel && ev.cmd.gate_serial != 0 && ev.frame > after_frame) {
+            publish_gate_finished(channel, ev.cmd.gate_serial);
+            if (ev.cmd.sequence) retire_sequence(ev.cmd.sequence);
+            continue;
+        }
+        g_pending_events[kept++] = ev;
+    }
+    g_pending_count = kept;
+    g_gate_tail[channel] = 0;
+}
+
+// 把命令放入事件时间线；门控音符不早于同一通道上一个门控音符的结束帧
+static void schedule_command(const LedcCommand& cmd) {
+    uint64_t frame = timestamp_to_frame(cmd.timestamp_ns);
+    if (cmd.gate_serial != 0) {
+        frame = std::max(frame, g_gate_tail[cmd.channel]);
+        g_gate_tail[cmd.channel] = frame + cmd.gate_frames; // 无限循环的序列与不限时长的音符一样记为 0
+    } else if (cmd.type == LEDC_CMD_DETACH || cmd.cancel_gates) {
+        cancel_pending_gates(cmd.channel, frame);
+    }
+    insert_pending_event(frame, cmd);
+}
+
+static bool command_ring_has_data() {
+    const LedcCommandSlot& slot = g_command_ring[g_command_tail & (LEDC_COMMAND_RING_SIZE - 1)];
+    return slot.sequence.load(std::memory_order_acquire) == g_command_tail + 1;
+}
+
+// 取出所有已发布的命令并放入事件时间线，每个音频周期调用一次
+static void drain_commands() {
+    for (;;) {
+        LedcCommandSlot& slot = g_command_ring[g_command_tail & (LEDC_COMMAND_RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != g_command_tail + 1) {
+            break;
+        }
+        schedule_command(slot.cmd);
+        slot.sequence.store(g_command_tail + LEDC_COMMAND_RING_SIZE, std::memory_order_release);
+        ++g_command_tail;
+    }
+}
+
+// 应用所有帧号不晚于 frame 的事件
+static void apply_due_events(uint64_t frame) {
+    uint32_t due = 0;
+    while (due < g_pending_count && g_pending_events[due].frame <= frame) {
+        apply_command(g_pending_events[due].cmd);
+        ++due;
+    }
+    if (due > 0) {
+        g_pending_count -= due;
+        memmove(g_pending_events, g_pending_events + due, g_pending_count * sizeof(LedcPendingEvent));
+    }
+}
+
+// 渲染 frames 帧到 out，在事件所在的帧处切分渲染循环
+static void render_frames(float* out, uint32_t frames, int mode) {
+    while (frames > 0) {
+        uint32_t chunk = frames < RENDER_CHUNK_FRAMES ? frames : RENDER_CHUNK_FRAMES;
+        uint32_t pos = 0;
+        while (pos < chunk) {
+            if (g_render_frame >= g_next_gate_end) expire_gates(g_render_frame);
+            if (g_render_frame >= g_next_mod_frame) update_modulation(g_render_frame);
+            apply_due_events(g_render_frame);
+            if (g_render_frame >= g_next_sample_frame) update_sample_lanes(g_render_frame);
+            uint32_t segment = chunk - pos;
+            if (g_pending_count > 0 && g_pending_events[0].frame - g_render_frame < segment) {
+                segment = (uint32_t)(g_pending_events[0].frame - g_render_frame);
+            }
+            if (g_next_gate_end - g_render_frame < segment) {
+                segment = (uint32_t)(g_next_gate_end - g_render_frame);
+            }
+            if (g_next_mod_frame - g_render_frame < segment) {
+                segment = (uint32_t)(g_next_mod_frame - g_render_frame);
+            }
+            if (g_next_sample_frame - g_render_frame < segment) {
+                segment = (uint32_t)(g_next_sample_frame - g_render_frame);
+            }
+            // 一次遍历混合所有活动通道的声音
+            mix_segment(g_mix_buffer + pos, segment, mode);
+            pos += segment;
+            g_render_frame += segment;
+            // 在用完预算的那一帧静音，推进到这里就通知，虚拟时间下延时结束时音符已经结束
+            if (g_render_frame >= g_next_gate_end) expire_gates(g_render_frame);
+            if (g_render_frame >= g_next_mod_frame) update_modulation(g_render_frame);
+        }
+        flush_mix_buffer(g_mix_buffer, out, chunk);
+        dc_block(g_dc_blocker, out, chunk);
+        out += chunk;
+        frames -= chunk;
+    }
+}
+
+static std::atomic<ledc_sim_output_cb_t> g_output_callback(nullptr);
+static std::atomic<void*> g_output_user(nullptr);
+// 渲染状态的所有权：实时模式下由音频回调持有，虚拟时间模式下由推进时钟的线程持有
+static std::mutex g_render_mutex;
+
+// --- 捕获缓冲区 ---
+// 单生产者单消费者的无锁环形缓冲区：渲染线程写入每一块输出，测试线程随时读取。
+// 缓冲区在 ledcSimStartCapture 时一次性分配，渲染线程中没有内存分配，
+// 读取跟不上时丢弃新数据并计数，不会阻塞渲染。
+struct CaptureRing {
+    float* data;                   // 受 g_render_mutex 保护地分配和释放
+    uint32_t capacity;             // 2 的幂
+    std::atomic<uint32_t> head;    // 写入位置，仅由渲染线程推进
+    std::atomic<uint32_t> tail;    // 读取位置，仅由读取线程推进
+    std::atomic<uint64_t> dropped; // 缓冲区满时丢弃的帧数
+};
+
+static CaptureRing g_capture = { NULL, 0, {0}, {0}, {0} };
+
+// 写入捕获缓冲区，调用者必须持有 g_render_mutex
+static void capture_write(const float* samples, uint32_t frames) {
+    CaptureRing& ring = g_capture;
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    uint32_t free_frames = ring.capacity - (head - ring.tail.load(std::memory_order_acquire));
+    uint32_t count = frames < free_frames ? frames : free_frames;
+    uint32_t offset = head & (ring.capacity - 1);
+    uint32_t first = std::min(count, ring.capacity - offset);
+    memcpy(ring.data + offset, samples, first * sizeof(float));
+    memcpy(ring.data, samples + first, (count - first) * sizeof(float));
+    ring.head.store(head + count, std::memory_order_release);
+    if (count < frames) ring.dropped.fetch_add(frames - count, std::memory_order_relaxed);
+}
+
+// WAV 录制（受 g_render_mutex 保护）
+#define WAV_CAPTURE_TAIL_MS 100 // 离线渲染结束后额外录制的尾音
+static ma_encoder g_wav_encoder;
+static bool g_wav_capturing = false;
+
+// 渲染 frames 帧最终输出，调用者必须持有 g_render_mutex
+static void render_output(float* out, uint32_t frames) {
+    int mode = g_osc_mode.load(std::memory_order_relaxed);
+
+    // 空闲快速路径：没有通道在发声、没有待处理的命令和事件、上一块的尾音也已衰减完，直接输出静音
+    if (g_ledc_active_mask.load(std::memory_order_relaxed) == 0 && g_render.active_mask == 0 && g_oversample.active_mask == 0 &&
+        g_ultrasonic_mask == 0 && g_ultrasonic_step == 0.0f &&
+        g_pending_count == 0 && g_next_gate_end == ~(uint64_t)0 && g_fade_mask == 0 && !command_ring_has_data() && render_tail_silent()) {
+        memset(out, 0, frames * sizeof(float));
+        g_render_frame += frames;
+    } else {
+        drain_commands();
+        render_frames(out, frames, mode);
+    }
+
+    ledc_sim_output_cb_t callback = g_output_callback.load(std::memory_order_acquire);
+    if (callback) callback(out, frames, g_output_user.load(std::memory_order_relaxed));
+    if (g_wav_capturing) ma_encoder_write_pcm_frames(&g_wav_encoder, out, frames, NULL);
+    if (g_capture.data) capture_write(out, frames);
+}
+
+// 音频回调函数，由 miniaudio 调用以生成音频样本
+void sim_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    (void)pInput;
+    (void)pDevice;
+    float* pOutputF32 = (float*)pOutput;
+
+    // 虚拟时间模式下音频由模拟时钟驱动，设备只输出静音
+    std::unique_lock<std::mutex> lock(g_render_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || simClockGetMode() == SIM_CLOCK_VIRTUAL) {
+        memset(pOutputF32, 0, frameCount * sizeof(float));
+        return;
+    }
+    sync_render_clock(monotonic_now_ns(), frameCount);
+    render_output(pOutputF32, frameCount);
+
+    // 唤醒中断分发线程。通知要取时钟锁，而切换时钟模式时持有时钟锁再取渲染锁，所以先释放渲染锁
+    bool fade_finished = g_fade_event_posted;
+    g_fade_event_posted = false;
+    lock.unlock();
+    SimClockWaiter* waiter = g_fade_isr_waiter.load();
+    if (fade_finished && waiter) simClockWaiterNotify(waiter);
+}
+
+// 模拟时钟推进时补齐音频：渲染到 now_ns 对应的帧为止（不含）
+static void ledc_clock_advance(uint64_t now_ns) {
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    uint64_t target = virtual_time_to_frame(now_ns);
+    static float block[RENDER_CHUNK_FRAMES];
+    while (g_render_frame < target) {
+        uint64_t remaining = target - g_render_frame;
+        uint32_t frames = remaining < RENDER_CHUNK_FRAMES ? (uint32_t)remaining : RENDER_CHUNK_FRAMES;
+        render_output(block, frames);
+    }
+}
+
+// 切换时钟模式后重新开始时间线：已发出的命令立即生效，相位、滤波器和帧号全部清零，
+// 所以每次切换到虚拟时间后运行同一段代码都会得到逐位相同的输出
+static void ledc_clock_reset(sim_clock_mode_t mode) {
+    (void)mode;
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    while (command_ring_has_data()) {
+        LedcCommandSlot& slot = g_command_ring[g_command_tail & (LEDC_COMMAND_RING_SIZE - 1)];
+        apply_command(slot.cmd);
+        slot.sequence.store(g_command_tail + LEDC_COMMAND_RING_SIZE, std::memory_order_release);
+        ++g_command_tail;
+    }
+    apply_due_events(~(uint64_t)0);
+    // 旧时间线上的门控音符没有意义了，全部视为结束
+    for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+        bool samples = g_voices[ch].samples;
+        finish_gate(ch);
+        g_gate_tail[ch] = 0;
+        if (samples) update_render_lane(ch); // PWM-DAC 通道保持最后一个采样的占空比
+    }
+    update_next_gate_end();
+    // 进行中的渐变直接跳到终点，回调照常触发
+    for (uint32_t bits = g_fade_mask; bits; bits &= bits - 1) {
+        int ch = __builtin_ctz(bits);
+        g_voices[ch].duty = g_voices[ch].fade_target;
+        finish_fade(ch, true);
+        update_render_lane(ch);
+    }
+    g_render_frame = 0;
+    for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+        g_voices[ch].lfo_phase = 0;
+    }
+    update_modulation(0);
+    g_clock_sync = RenderClockSync();
+    memset(g_render.phase, 0, sizeof(g_render.phase));
+    memset(g_oversample.phase, 0, sizeof(g_oversample.phase));
+    reset_oversample_filters(g_oversample);
+    memset(g_mix_buffer, 0, sizeof(g_mix_buffer));
+    g_dc_blocker.x1 = g_dc_blocker.y1 = 0.0f;
+    g_ultrasonic_step = 0.0f;
+}
+
+// --- 音频后端 ---
+// 默认打开系统的播放设备，没有声卡（无头 CI）时退回 miniaudio 的 null 后端：
+// null 后端没有任何输出，但它的设备线程仍按实时速度调用 sim_data_callback，
+// 命令时间戳、事件调度和输出回调 / 捕获缓冲区的行为都与有声卡时一致。
+static std::atomic<int> g_audio_backend(LEDC_SIM_BACKEND_AUTO);
+static ma_context g_null_context;
+static bool g_null_context_ready = false;
+
+static bool open_audio_device(bool null_backend) {
+    ma_context* context = NULL;
+    if (null_backend) {
+        if (!g_null_context_ready) {
+            ma_backend backends[] = { ma_backend_null };
+            if (ma_context_init(backends, 1, NULL, &g_null_context) != MA_SUCCESS) {
+                std::cerr << "[SIM_LEDC] Failed to initialize the null backend." << std::endl;
+                return false;
+            }
+            g_null_context_ready = true;
+        }
+        context = &g_null_context;
+    }
+
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format   = ma_format_f32;
+    deviceConfig.playback.channels = 1; // Mono
+    deviceConfig.sampleRate        = SIM_SAMPLE_RATE;
+    deviceConfig.dataCallback      = sim_data_callback;
+
+    if (ma_device_init(context, &deviceConfig, &g_audio_device) != MA_SUCCESS) {
+        std::cerr << "[SIM_LEDC] Failed to initialize audio device." << std::endl;
+        return false;
+    }
+
+    if (ma_device_start(&g_audio_device) != MA_SUCCESS) {
+        std::cerr << "[SIM_LEDC] Failed to start audio device." << std::endl;
+        ma_device_uninit(&g_audio_device);
+        return false;
+    }
+    return true;
+}
+
+// 确保 miniaudio 已初始化
+static void ensure_audio_initialized() {
+    if (g_audio_initialized) return;
 
-// 音频回调函数，由 miniaudio 调用以生成音频样本
-void sim_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
-    (void)pInput;
-    float* pOutputF32 = (float*)pOutput;
-    double sampleRate = pDevice->sampleRate;
+    // 通道状态只初始化一次；音频设备打开失败时下次调用会重试，但不能清掉已附加的通道
+    static bool state_initialized = false;
+    if (!state_initialized) {
+        init_blep_table();
+        init_halfband_filters();
+        init_lfo_tables();
+        init_command_ring();
+        simClockSetHooks(ledc_clock_advance, ledc_clock_reset);
+        for(int i=0; i<NUM_LEDC_CHANNELS; ++i) {
+            g_ledc_channels[i].frequency.store(0);
+            g_ledc_channels[i].clock_divider.store(0);
+            g_ledc_channels[i].duty.store(0);
+            g_ledc_channels[i].resolution_max_duty.store(1023); // 默认10位
+            g_ledc_channels[i].resolution.store(10);
+            g_ledc_channels[i].attached.store(false);
+            g_voices[i] = LedcVoice();
+            g_voices[i].mod_factor = 1.0f;
+            g_render.phase[i] = 0;
+            g_oversample.phase[i] = 0;
+            update_render_lane(i);
+        }
+        state_initialized = true;
+    }
+    // 虚拟时间模式不需要音频设备，切回实时模式后的下一次调用再打开
+    if (simClockGetMode() == SIM_CLOCK_VIRTUAL) return;
 
-    for (ma_uint32 i = 0; i < frameCount; ++i) {
-        pOutputF32[i] = 0.0f;
+    int backend = g_audio_backend.load();
+    bool headless = backend == LEDC_SIM_BACKEND_NULL;
+    bool opened = !headless && open_audio_device(false);
+    if (!opened && backend == LEDC_SIM_BACKEND_AUTO) {
+        std::cerr << "[SIM_LEDC] No usable audio device, falling back to the null backend." << std::endl;
+        headless = true;
+    }
+    if (!opened && headless) {
+        opened = open_audio_device(true);
+    }
+    if (!opened) {
+        return;
     }
 
-    // 混合所有活动通道的声音
-    for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
-        if (!g_ledc_channels[ch].attached.load() || g_ledc_channels[ch].duty.load() == 0) {
-            continue;
-        }
+    g_audio_initialized = true;
+    std::cout << "[SIM_LEDC] miniaudio device initialized and started (backend: "
+              << ma_get_backend_name(g_audio_device.pContext->backend) << (headless ? ", headless" : "") << ")." << std::endl;
+}
+
+// --- 渐变完成中断 ---
+// 真机上 ledcFadeWithInterrupt 的回调在 LEDC 中断里执行，这里由一个独立的中断分发线程调用：
+// 音频线程只发布完成事件，实时模式下渲染完一个周期后唤醒分发线程；
+// 虚拟时间模式下分发线程延时到渐变结束的时刻，时钟推进到那里时渲染器已经发布了事件。
+// 分发线程是模拟时钟的参与线程，回调运行期间虚拟时间不会推进。
+struct FadeIsr {
+    void (*func)(void);
+    void (*func_arg)(void*);
+    void* arg;
+    uint32_t serial; // 通道上最近一次渐变的序号，旧渐变的事件被忽略
+    uint64_t end_ns; // 渐变结束的时刻，虚拟时间模式下作为分发线程的期限
+    bool armed;      // 渐变结束时需要调用回调
+};
+
+static std::mutex g_fade_isr_mutex;
+static FadeIsr g_fade_isr[NUM_LEDC_CHANNELS];
+static uint32_t g_fade_serial_next = 0;
+static bool g_fade_isr_stop = false;
 
-        double freq = g_ledc_channels[ch].frequency.load();
-        if (freq <= 0) continue;
+static bool pop_fade_event(LedcFadeEvent* ev) {
+    uint32_t tail = g_fade_event_tail.load(std::memory_order_relaxed);
+    if (tail == g_fade_event_head.load(std::memory_order_acquire)) return false;
+    *ev = g_fade_events[tail & (LEDC_FADE_EVENT_RING_SIZE - 1)];
+    g_fade_event_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
 
-        double phase = g_ledc_channels[ch].phase.load();
-        double phase_increment = freq / sampleRate;
-        
-        for (ma_uint32 frame = 0; frame < frameCount; ++frame) {
-            // 生成方波
-            if (phase < 0.5) {
-                pOutputF32[frame] += 0.1f; // 幅度，多个通道时需要减小
+static void fade_isr_main() {
+    SimClockWaiter* waiter = g_fade_isr_waiter.load();
+    std::unique_lock<std::mutex> lock(g_fade_isr_mutex);
+    while (!g_fade_isr_stop) {
+        bool is_virtual = simClockGetMode() == SIM_CLOCK_VIRTUAL;
+        if (is_virtual) {
+            // 虚拟时间下渲染器只在时钟推进时运行，先让已提交的命令在当前帧生效（时长为 0 的渐变立即结束）
+            std::lock_guard<std::mutex> render_lock(g_render_mutex);
+            drain_commands();
+            apply_due_events(g_render_frame);
+        }
+        LedcFadeEvent ev;
+        while (pop_fade_event(&ev)) {
+            FadeIsr& isr = g_fade_isr[ev.channel];
+            if (!isr.armed || isr.serial != ev.serial) continue;
+            isr.armed = false;
+            if (!ev.completed) continue; // 被取消的渐变不触发中断
+            void (*func)(void) = isr.func;
+            void (*func_arg)(void*) = isr.func_arg;
+            void* arg = isr.arg;
+            lock.unlock(); // 回调里可以再次调用 ledcFade
+            if (func_arg) {
+                func_arg(arg);
             } else {
-                pOutputF32[frame] -= 0.1f;
+                func();
             }
-            phase += phase_increment;
-            if (phase >= 1.0) {
-                phase -= 1.0;
+            lock.lock();
+        }
+        uint64_t deadline = SIM_CLOCK_FOREVER;
+        if (is_virtual) {
+            uint64_t now = simClockNowNs();
+            for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+                FadeIsr& isr = g_fade_isr[ch];
+                if (!isr.armed) continue;
+                if (isr.end_ns <= now) {
+                    isr.armed = false; // 已经渲染过结束的帧仍没有事件：事件因缓冲区满被丢弃
+                    continue;
+                }
+                deadline = std::min(deadline, isr.end_ns);
             }
         }
-        g_ledc_channels[ch].phase.store(phase);
+        lock.unlock();
+        simClockWaiterWait(waiter, deadline);
+        lock.lock();
     }
+    lock.unlock();
+    simClockThreadEnd();
 }
 
-// 确保 miniaudio 已初始化
-static void ensure_audio_initialized() {
-    if (g_audio_initialized) return;
+// 分发线程在第一次使用带回调的渐变时启动，程序退出时停止
+struct FadeIsrDispatcher {
+    std::thread thread;
 
-    for(int i=0; i<NUM_LEDC_CHANNELS; ++i) {
-        g_ledc_channels[i].frequency.store(0.0);
-        g_ledc_channels[i].phase.store(0.0);
-        g_ledc_channels[i].duty.store(0);
-        g_ledc_channels[i].resolution_max_duty.store(1023); // 默认10位
-        g_ledc_channels[i].attached.store(false);
+    ~FadeIsrDispatcher() {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(g_fade_isr_mutex);
+            g_fade_isr_stop = true;
+        }
+        simClockWaiterNotify(g_fade_isr_waiter.load());
+        thread.join();
     }
+};
 
-    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
-    deviceConfig.playback.format   = ma_format_f32;
-    deviceConfig.playback.channels = 1; // Mono
-    deviceConfig.sampleRate        = 48000;
-    deviceConfig.dataCallback      = sim_data_callback;
+static FadeIsrDispatcher g_fade_isr_dispatcher;
+static std::once_flag g_fade_isr_once;
 
-    if (ma_device_init(NULL, &deviceConfig, &g_audio_device) != MA_SUCCESS) {
-        std::cerr << "[SIM_LEDC] Failed to initialize audio device." << std::endl;
-        return;
+static void ensure_fade_isr_started() {
+    std::call_once(g_fade_isr_once, [] {
+        g_fade_isr_waiter.store(simClockWaiterCreate());
+        simClockThreadBegin(); // 在创建线程之前登记，虚拟时间不会在线程启动前推进
+        g_fade_isr_dispatcher.thread = std::thread(fade_isr_main);
+    });
+}
+
+// ledcFade 系列共用的实现：占空比从 start_duty 开始，由渲染器在 max_fade_time_ms 内线性变化到 target_duty
+static bool fade_config(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms,
+                        void (*func)(void), void (*func_arg)(void*), void* arg) {
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("Pin %u is not attached to LEDC. Call ledcAttach first!", pin);
+        return false;
     }
-    
-    if (ma_device_start(&g_audio_device) != MA_SUCCESS) {
-        std::cerr << "[SIM_LEDC] Failed to start audio device." << std::endl;
-        ma_device_uninit(&g_audio_device);
-        return;
+    if (max_fade_time_ms < 0) {
+        log_e("ledcFade: Invalid fade time %d ms.", max_fade_time_ms);
+        return false;
+    }
+    uint32_t max_duty = g_ledc_channels[channel].resolution_max_duty.load();
+    if (target_duty > max_duty) {
+        log_w("Target duty %u was adjusted to the maximum duty %u", target_duty, max_duty);
+        target_duty = max_duty + 1;
     }
+    if (start_duty > max_duty) {
+        log_w("Starting duty %u was adjusted to the maximum duty %u", start_duty, max_duty);
+        start_duty = max_duty + 1;
+    }
+    bool has_isr = func != nullptr || func_arg != nullptr;
+    if (has_isr) ensure_fade_isr_started();
 
-    g_audio_initialized = true;
-    std::cout << "[SIM_LEDC] miniaudio device initialized and started." << std::endl;
+    LedcCommand cmd = make_command(LEDC_CMD_FADE, (uint8_t)channel);
+    cmd.duty = start_duty;
+    cmd.fade_target = target_duty;
+    cmd.fade_frames = (uint32_t)((uint64_t)max_fade_time_ms * SIM_SAMPLE_RATE / 1000);
+    {
+        // 登记回调和提交命令在同一把锁内，分发线程不会先看到事件或先同步到命令
+        std::lock_guard<std::mutex> lock(g_fade_isr_mutex);
+        FadeIsr& isr = g_fade_isr[channel];
+        cmd.fade_serial = ++g_fade_serial_next;
+        isr.func = func;
+        isr.func_arg = func_arg;
+        isr.arg = arg;
+        isr.serial = cmd.fade_serial;
+        isr.end_ns = simClockNowNs() + (uint64_t)max_fade_time_ms * 1000000u;
+        isr.armed = has_isr && (g_audio_initialized || simClockGetMode() == SIM_CLOCK_VIRTUAL);
+        // 寄存器里直接记为目标占空比
+        g_ledc_channels[channel].duty.store(target_duty);
+        update_active_mask((uint8_t)channel, start_duty != 0 || target_duty != 0);
+        push_command(cmd);
+    }
+    if (has_isr) simClockWaiterNotify(g_fade_isr_waiter.load()); // 分发线程重新计算期限
+    return true;
 }
 
 // --- 模拟 LEDC 函数实现 ---
@@ -124,10 +2133,20 @@ bool ledcAttachChannel(uint8_t pin, uint32_t freq, uint8_t resolution, uint8_t c
         log_e("ledcAttachChannel: Invalid channel %d", channel);
         return false;
     }
+    LedcTimerConfig cfg;
+    if (!ledc_apply_timer(channel, freq, resolution, &cfg)) {
+        return false;
+    }
     g_pin_to_channel[pin] = channel;
-    g_ledc_channels[channel].resolution_max_duty.store((1 << resolution) - 1);
-    g_ledc_channels[channel].frequency.store((double)freq);
+    g_ledc_channels[channel].duty.store(0);
     g_ledc_channels[channel].attached.store(true);
+    update_active_mask(channel, false);
+
+    LedcCommand cmd = make_command(LEDC_CMD_ATTACH, channel);
+    cmd.resolution = resolution;
+    cmd.phase_increment = cfg.phase_increment;
+    cmd.above_nyquist = cfg.above_nyquist;
+    push_command(cmd);
     log_d("Attached pin %d to channel %d with freq %u Hz, %d-bit resolution", pin, channel, freq, resolution);
     return true;
 }
@@ -147,33 +2166,63 @@ bool ledcWriteChannel(uint8_t channel, uint32_t duty) {
         return false;
     }
     g_ledc_channels[channel].duty.store(duty);
+    update_active_mask(channel, duty != 0);
+
+    LedcCommand cmd = make_command(LEDC_CMD_DUTY, channel);
+    cmd.duty = duty;
+    push_command(cmd);
     // log_d("Wrote duty %u to channel %d", duty, channel);
     return true;
 }
 
+// ledcWriteTone 与门控音符共用的实现，gate_serial 为 0 时是普通的 ledcWriteTone
+static uint32_t write_tone(int channel, uint32_t freq, uint32_t gate_serial, uint32_t gate_frames) {
+    if (freq == 0) {
+        g_ledc_channels[channel].duty.store(0);
+        update_active_mask((uint8_t)channel, false);
+        LedcCommand cmd = make_command(LEDC_CMD_DUTY, (uint8_t)channel);
+        cmd.gate_serial = gate_serial;
+        cmd.gate_frames = gate_frames;
+        push_command(cmd);
+        return 0;
+    }
+    uint8_t resolution = g_ledc_channels[channel].resolution.load();
+    LedcTimerConfig cfg;
+    if (!ledc_apply_timer(channel, freq, resolution, &cfg)) {
+        return 0;
+    }
+    // 50% duty cycle for a tone
+    uint32_t duty = g_ledc_channels[channel].resolution_max_duty.load() / 2;
+    g_ledc_channels[channel].duty.store(duty);
+    update_active_mask((uint8_t)channel, duty != 0);
+
+    // 频率和占空比放在同一条命令里，音频线程不会只看到其中一半
+    LedcCommand cmd = make_command(LEDC_CMD_TONE, (uint8_t)channel);
+    cmd.resolution = resolution;
+    cmd.phase_increment = cfg.phase_increment;
+    cmd.above_nyquist = cfg.above_nyquist;
+    cmd.duty = duty;
+    cmd.gate_serial = gate_serial;
+    cmd.gate_frames = gate_frames;
+    push_command(cmd);
+    return g_ledc_channels[channel].frequency.load();
+}
+
 uint32_t ledcWriteTone(uint8_t pin, uint32_t freq) {
     int channel = g_pin_to_channel[pin];
     if (channel == -1) {
         log_e("ledcWriteTone: Pin %d not attached to any channel.", pin);
         return 0;
     }
-    g_ledc_channels[channel].frequency.store((double)freq);
-    // 50% duty cycle for a tone
-    uint32_t duty = (freq > 0) ? (g_ledc_channels[channel].resolution_max_duty.load() / 2) : 0;
-    ledcWrite(pin, duty);
     // log_d("Wrote tone %u Hz to pin %d (channel %d)", freq, pin, channel);
-    return freq;
+    return write_tone(channel, freq, 0, 0);
 }
 
 uint32_t ledcWriteNote(uint8_t pin, note_t note, uint8_t octave) {
-    const uint16_t noteFrequencyBase[] = {
-        // C,   C#,  D,   D#,  E,   F,   F#,  G,   G#,  A,   A#,  B
-        4186, 4435, 4699, 4978, 5274, 5588, 5920, 6272, 6645, 7040, 7459, 7902
-    };
-    if (note >= NOTE_MAX || octave > 8) {
+    uint32_t freq = ledcSimNoteFrequency(note, octave);
+    if (freq == 0) {
         return 0;
     }
-    uint32_t freq = noteFrequencyBase[note] / (1 << (8 - octave));
     return ledcWriteTone(pin, freq);
 }
 
@@ -186,7 +2235,7 @@ uint32_t ledcRead(uint8_t pin) {
 uint32_t ledcReadFreq(uint8_t pin) {
     int channel = g_pin_to_channel[pin];
     if (channel == -1) return 0;
-    return (uint32_t)g_ledc_channels[channel].frequency.load();
+    return g_ledc_channels[channel].frequency.load();
 }
 
 bool ledcDetach(uint8_t pin) {
@@ -195,6 +2244,10 @@ bool ledcDetach(uint8_t pin) {
         g_ledc_channels[channel].attached.store(false);
         g_ledc_channels[channel].duty.store(0);
         g_pin_to_channel[pin] = -1;
+        update_active_mask((uint8_t)channel, false);
+
+        LedcCommand cmd = make_command(LEDC_CMD_DETACH, (uint8_t)channel);
+        push_command(cmd);
         log_d("Detached pin %d from channel %d", pin, channel);
     }
     return true;
@@ -206,10 +2259,633 @@ uint32_t ledcChangeFrequency(uint8_t pin, uint32_t freq, uint8_t resolution) {
         log_e("ledcChangeFrequency: Pin %d not attached.", pin);
         return 0;
     }
-    g_ledc_channels[channel].frequency.store((double)freq);
-    g_ledc_channels[channel].resolution_max_duty.store((1 << resolution) - 1);
+    LedcTimerConfig cfg;
+    if (!ledc_apply_timer(channel, freq, resolution, &cfg)) {
+        return 0;
+    }
+
+    LedcCommand cmd = make_command(LEDC_CMD_TIMER, (uint8_t)channel);
+    cmd.resolution = resolution;
+    cmd.phase_increment = cfg.phase_increment;
+    cmd.above_nyquist = cfg.above_nyquist;
+    push_command(cmd);
     log_d("Changed pin %d (channel %d) to freq %u Hz, %d-bit resolution", pin, channel, freq, resolution);
-    return freq;
+    return g_ledc_channels[channel].frequency.load();
+}
+
+bool ledcFade(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms) {
+    return fade_config(pin, start_duty, target_duty, max_fade_time_ms, nullptr, nullptr, nullptr);
+}
+
+bool ledcFadeWithInterrupt(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms, void (*userFunc)(void)) {
+    return fade_config(pin, start_duty, target_duty, max_fade_time_ms, userFunc, nullptr, nullptr);
+}
+
+bool ledcFadeWithInterruptArg(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms,
+                              void (*userFunc)(void*), void* arg) {
+    return fade_config(pin, start_duty, target_duty, max_fade_time_ms, nullptr, userFunc, arg);
+}
+
+// --- 模拟器扩展接口 ---
+
+uint32_t ledcSimNoteFrequency(note_t note, uint8_t octave) {
+    static const uint16_t noteFrequencyBase[] = {
+        // C,   C#,  D,   D#,  E,   F,   F#,  G,   G#,  A,   A#,  B
+        4186, 4435, 4699, 4978, 5274, 5588, 5920, 6272, 6645, 7040, 7459, 7902
+    };
+    if (note >= NOTE_MAX || octave > 8) {
+        return 0;
+    }
+    return noteFrequencyBase[note] / (1 << (8 - octave));
+}
+
+static uint32_t next_gate_serial(int channel) {
+    uint32_t serial = g_gate_serial_next[channel].fetch_add(1) + 1;
+    if (serial == 0) serial = g_gate_serial_next[channel].fetch_add(1) + 1; // 0 表示非门控命令
+    return serial;
+}
+
+uint32_t ledcSimWriteToneGated(uint8_t pin, uint32_t freq, uint32_t duration_ms) {
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimWriteToneGated: Pin %d not attached to any channel.", pin);
+        return 0;
+    }
+    uint32_t serial = next_gate_serial(channel);
+    write_tone(channel, freq, serial, (uint32_t)((uint64_t)duration_ms * SIM_SAMPLE_RATE / 1000));
+    return serial;
+}
+
+// 把准备好的序列交给音频线程，返回它的门控序号
+static uint32_t submit_sequence(int channel, std::unique_ptr<LedcSequence> seq, uint32_t repeat) {
+    uint32_t serial = next_gate_serial(channel);
+    g_ledc_channels[channel].duty.store(0);
+    update_active_mask((uint8_t)channel, false); // 序列自带门控，渲染器不会走空闲快速路径
+
+    LedcCommand cmd = make_command(LEDC_CMD_SEQUENCE, (uint8_t)channel);
+    cmd.gate_serial = serial;
+    uint64_t total = repeat ? seq->total_frames * repeat : 0;
+    cmd.gate_frames = total <= 0xFFFFFFFFu ? (uint32_t)total : 0;
+    cmd.sequence = seq.release();
+    if (!g_audio_initialized && simClockGetMode() != SIM_CLOCK_VIRTUAL) {
+        delete cmd.sequence; // 没有渲染器接收
+        return 0;
+    }
+    push_command(cmd);
+    return serial;
+}
+
+uint32_t ledcSimPlaySequence(uint8_t pin, const ledc_sim_note_t* notes, uint32_t count, uint32_t repeat) {
+    collect_retired_sequences();
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimPlaySequence: Pin %d not attached to any channel.", pin);
+        return 0;
+    }
+    if (notes == NULL || count == 0) {
+        log_e("ledcSimPlaySequence: Empty sequence.");
+        return 0;
+    }
+    // 定时器参数和帧数在这里一次算好，音频线程只需按下标取用
+    std::unique_ptr<LedcSequence> seq(new LedcSequence());
+    seq->resolution = g_ledc_channels[channel].resolution.load();
+    seq->repeat = repeat;
+    seq->total_frames = 0;
+    seq->storage.resize(count);
+    seq->steps = seq->storage.data();
+    seq->step_count = count;
+    uint32_t full_scale = 1u << seq->resolution;
+    for (uint32_t i = 0; i < count; ++i) {
+        const ledc_sim_note_t& note = notes[i];
+        LedcSequenceStep& step = seq->storage[i];
+        LedcTimerConfig cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        if (note.frequency != 0 && note.duty != 0 && !ledc_calc_timer(note.frequency, seq->resolution, &cfg)) {
+            log_e("ledcSimPlaySequence: Note %u (%u Hz) cannot be generated at %d-bit resolution.", i, note.frequency,
+                  seq->resolution);
+            return 0;
+        }
+        step.phase_increment = cfg.phase_increment;
+        step.above_nyquist = cfg.above_nyquist;
+        step.duty = note.frequency != 0 ? std::min(note.duty, full_scale) : 0;
+        step.note_frames = (uint32_t)((uint64_t)note.duration_ms * SIM_SAMPLE_RATE / 1000);
+        step.gap_frames = (uint32_t)((uint64_t)note.gap_ms * SIM_SAMPLE_RATE / 1000);
+        step.divider = cfg.divider;
+        step.clock_hz = cfg.clock_hz;
+        seq->total_frames += (uint64_t)step.note_frames + step.gap_frames;
+    }
+    if (seq->total_frames == 0) {
+        log_e("ledcSimPlaySequence: Sequence has zero length.");
+        return 0;
+    }
+    return submit_sequence(channel, std::move(seq), repeat);
+}
+
+uint32_t ledcSimPlayMelody(uint8_t pin, const ledc_sim_melody_t* melody, uint32_t repeat) {
+    collect_retired_sequences();
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimPlayMelody: Pin %d not attached to any channel.", pin);
+        return 0;
+    }
+    if (melody == NULL || melody->count == 0 || melody->total_frames == 0) {
+        log_e("ledcSimPlayMelody: Empty melody.");
+        return 0;
+    }
+    // 分频系数和相位增量是按编译时的分辨率算好的，不再换算
+    uint8_t resolution = g_ledc_channels[channel].resolution.load();
+    if (melody->resolution != resolution) {
+        log_e("ledcSimPlayMelody: Melody was compiled for %u-bit resolution, pin %d uses %u-bit.", melody->resolution, pin,
+              resolution);
+        return 0;
+    }
+    std::unique_ptr<LedcSequence> seq(new LedcSequence());
+    seq->resolution = resolution;
+    seq->repeat = repeat;
+    seq->total_frames = melody->total_frames;
+    seq->steps = melody->steps;
+    seq->step_count = melody->count;
+    return submit_sequence(channel, std::move(seq), repeat);
+}
+
+// 每个通道上一个采样块结束位置的小数部分（0.32 定点），只由提交采样块的线程使用
+static uint32_t g_sample_residual[NUM_LEDC_CHANNELS];
+
+uint32_t ledcSimWriteSamples(uint8_t pin, const uint32_t* duties, uint32_t count, uint32_t sample_rate) {
+    collect_retired_sequences();
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimWriteSamples: Pin %d not attached to any channel.", pin);
+        return 0;
+    }
+    if (duties == NULL || count == 0 || sample_rate == 0 || sample_rate > SIM_SAMPLE_RATE) {
+        log_e("ledcSimWriteSamples: Invalid samples or sample rate %u Hz.", sample_rate);
+        return 0;
+    }
+    uint64_t step = ((uint64_t)SIM_SAMPLE_RATE << 32) / sample_rate;
+    if ((uint64_t)count * (SIM_SAMPLE_RATE / sample_rate + 1) > 0x7FFFFFFFu) {
+        log_e("ledcSimWriteSamples: Block of %u samples is too long.", count);
+        return 0;
+    }
+    std::unique_ptr<LedcSequence> seq(new LedcSequence());
+    seq->resolution = g_ledc_channels[channel].resolution.load();
+    seq->repeat = 1;
+    seq->steps = NULL;
+    seq->step_count = 0;
+    seq->samples.assign(duties, duties + count);
+    seq->sample_step = step;
+    // 块长向下取整到帧，不足一帧的余数交给下一块：首尾相接的块按理想时刻排列，不会随块数累积误差
+    uint32_t& residual = g_sample_residual[channel];
+    uint64_t end = residual + (uint64_t)count * step;
+    if ((end >> 32) == 0) end = 1ull << 32;
+    seq->sample_offset = residual;
+    seq->total_frames = end >> 32;
+    residual = (uint32_t)end;
+    return submit_sequence(channel, std::move(seq), 1);
+}
+
+uint32_t ledcSimSweep(uint8_t pin, uint32_t start_freq, uint32_t end_freq, uint32_t duration_ms, ledc_sim_sweep_t curve) {
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimSweep: Pin %d not attached to any channel.", pin);
+        return 0;
+    }
+    uint32_t frames = (uint32_t)((uint64_t)duration_ms * SIM_SAMPLE_RATE / 1000);
+    if (start_freq == 0 || end_freq == 0 || frames == 0) {
+        log_e("ledcSimSweep: Invalid sweep %u Hz -> %u Hz over %u ms.", start_freq, end_freq, duration_ms);
+        return 0;
+    }
+    // 两端都必须是定时器能产生的频率；结束后 ledcReadFreq 读到的是终点频率
+    uint8_t resolution = g_ledc_channels[channel].resolution.load();
+    LedcTimerConfig start_cfg;
+    LedcTimerConfig end_cfg;
+    if (!ledc_calc_timer(start_freq, resolution, &start_cfg) || !ledc_apply_timer(channel, end_freq, resolution, &end_cfg)) {
+        log_e("ledcSimSweep: %u Hz -> %u Hz can not be achieved at %d-bit resolution.", start_freq, end_freq, resolution);
+        return 0;
+    }
+    uint32_t duty = g_ledc_channels[channel].resolution_max_duty.load() / 2;
+    g_ledc_channels[channel].duty.store(duty);
+    update_active_mask((uint8_t)channel, true);
+
+    // 相位增量按子块中点取值，第一个子块从起点偏移半个子块
+    const double inc_per_hz = 4294967296.0 / SIM_SAMPLE_RATE;
+    double start_inc = start_freq * inc_per_hz;
+    double end_inc = end_freq * inc_per_hz;
+    double blocks = (double)frames / SWEEP_BLOCK_FRAMES;
+    LedcCommand cmd = make_command(LEDC_CMD_SWEEP, (uint8_t)channel);
+    cmd.resolution = resolution;
+    cmd.duty = duty;
+    cmd.gate_serial = next_gate_serial(channel);
+    cmd.gate_frames = frames;
+    cmd.sweep_exponential = curve == LEDC_SIM_SWEEP_EXPONENTIAL;
+    if (cmd.sweep_exponential) {
+        cmd.sweep_rate = std::pow(end_inc / start_inc, 1.0 / blocks);
+        cmd.sweep_increment = start_inc * std::sqrt(cmd.sweep_rate);
+    } else {
+        cmd.sweep_rate = (end_inc - start_inc) / blocks;
+        cmd.sweep_increment = start_inc + cmd.sweep_rate / 2;
+    }
+    push_command(cmd);
+    return cmd.gate_serial;
+}
+
+bool ledcSimStopSequence(uint8_t pin) {
+    collect_retired_sequences();
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) {
+        log_e("ledcSimStopSequence: Pin %d not attached to any channel.", pin);
+        return false;
+    }
+    // 通道上的任何命令都会取消正在播放的序列，这里用占空比 0 让通道同时静音
+    g_ledc_channels[channel].duty.store(0);
+    update_active_mask((uint8_t)channel, false);
+    LedcCommand cmd = make_command(LEDC_CMD_DUTY, (uint8_t)channel);
+    cmd.cancel_gates = true;
+    push_command(cmd);
+    return true;
+}
+
+void ledcSimScheduleAt(uint64_t time_ns) {
+    t_schedule_time_ns = time_ns;
+}
+
+bool ledcSimWaitToneGate(uint8_t pin, uint32_t serial, uint64_t deadline_ns) {
+    int channel = g_pin_to_channel[pin];
+    if (channel == -1) return true; // 已分离，音符不会再响
+    std::atomic<uint32_t>& finished = g_gate_finished[channel];
+    if (gate_serial_reached(finished.load(), serial)) return true;
+
+    if (simClockGetMode() == SIM_CLOCK_VIRTUAL) {
+        // 虚拟时间下渲染随时钟推进，而等待中的线程醒着时渲染器一定空闲：
+        // 先让已发出的命令在当前帧生效，再延时到下一个事件或门控结束的帧，逐个检查
+        for (;;) {
+            uint64_t next_frame;
+            {
+                std::lock_guard<std::mutex> lock(g_render_mutex);
+                drain_commands();
+                apply_due_events(g_render_frame);
+                next_frame = g_next_gate_end;
+                if (g_pending_count > 0) next_frame = std::min(next_frame, g_pending_events[0].frame);
+            }
+            if (gate_serial_reached(finished.load(), serial)) return true;
+            uint64_t now = simClockNowNs();
+            if (now >= deadline_ns) return false;
+            uint64_t until = next_frame == ~(uint64_t)0 ? deadline_ns : std::min(deadline_ns, virtual_frame_to_time(next_frame));
+            simClockSleepNs(until > now ? until - now : 1);
+        }
+    }
+    if (!g_audio_initialized) return false; // 没有音频线程推进渲染
+
+    std::unique_lock<std::mutex> lock(g_gate_mutex);
+    g_gate_waiters.fetch_add(1);
+    auto reached = [&finished, serial] { return gate_serial_reached(finished.load(), serial); };
+    bool done;
+    if (deadline_ns == SIM_CLOCK_FOREVER) {
+        g_gate_cv.wait(lock, reached);
+        done = true;
+    } else {
+        std::chrono::steady_clock::time_point until{std::chrono::nanoseconds(deadline_ns)};
+        done = g_gate_cv.wait_until(lock, until, reached);
+    }
+    g_gate_waiters.fetch_sub(1);
+    return done;
+}
+
+void ledcSimSetOscillator(ledc_sim_osc_t mode) {
+    g_osc_mode.store((int)mode, std::memory_order_relaxed);
+}
+
+ledc_sim_osc_t ledcSimGetOscillator(void) {
+    return (ledc_sim_osc_t)g_osc_mode.load(std::memory_order_relaxed);
+}
+
+void ledcSimSetRenderMode(ledc_sim_render_t mode) {
+    g_render_mode.store((int)mode, std::memory_order_relaxed);
+}
+
+ledc_sim_render_t ledcSimGetRenderMode(void) {
+    return (ledc_sim_render_t)g_render_mode.load(std::memory_order_relaxed);
+}
+
+void ledcSimSetChannelOversampling(uint8_t channel, bool enable) {
+    if (channel >= NUM_LEDC_CHANNELS) {
+        log_e("ledcSimSetChannelOversampling: Invalid channel %d", channel);
+        return;
+    }
+    if (enable) {
+        g_oversample_request.fetch_or(1u << channel, std::memory_order_relaxed);
+    } else {
+        g_oversample_request.fetch_and(~(1u << channel), std::memory_order_relaxed);
+    }
+}
+
+bool ledcSimSetModulation(uint8_t channel, float rate_hz, float depth_cents, ledc_sim_lfo_t waveform) {
+    const float max_rate = (float)SIM_SAMPLE_RATE / MOD_BLOCK_FRAMES / 2; // LFO 每个周期至少取两次值
+    if (channel >= NUM_LEDC_CHANNELS || waveform < 0 || waveform >= LFO_WAVEFORMS || !(rate_hz >= 0.0f) ||
+        rate_hz > max_rate || !(std::fabs(depth_cents) <= 4800.0f)) {
+        log_e("ledcSimSetModulation: Invalid modulation on channel %d (%.2f Hz, %.1f cents)", channel, rate_hz, depth_cents);
+        return false;
+    }
+    ensure_audio_initialized();
+    LedcCommand cmd = make_command(LEDC_CMD_MODULATION, channel);
+    cmd.lfo_waveform = (uint8_t)waveform;
+    cmd.lfo_depth = depth_cents / 1200.0f;
+    if (rate_hz > 0.0f && depth_cents != 0.0f) {
+        uint32_t inc = (uint32_t)std::lround((double)rate_hz * MOD_BLOCK_FRAMES / SIM_SAMPLE_RATE * 4294967296.0);
+        cmd.lfo_increment = inc ? inc : 1;
+    }
+    push_command(cmd);
+    return true;
+}
+
+bool ledcSimGetChannelOversampling(uint8_t channel) {
+    if (channel >= NUM_LEDC_CHANNELS) return false;
+    return (g_oversample_request.load(std::memory_order_relaxed) >> channel) & 1;
+}
+
+void ledcSimSetOutputCallback(ledc_sim_output_cb_t callback, void* user) {
+    g_output_user.store(user, std::memory_order_relaxed);
+    g_output_callback.store(callback, std::memory_order_release);
+}
+
+bool ledcSimStartWavCapture(const char* path) {
+    ledcSimStopWavCapture();
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, 1, SIM_SAMPLE_RATE);
+    if (ma_encoder_init_file(path, &config, &g_wav_encoder) != MA_SUCCESS) {
+        log_e("ledcSimStartWavCapture: Failed to open %s", path);
+        return false;
+    }
+    g_wav_capturing = true;
+    return true;
+}
+
+void ledcSimStopWavCapture(void) {
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    if (!g_wav_capturing) return;
+    ma_encoder_uninit(&g_wav_encoder);
+    g_wav_capturing = false;
+}
+
+bool ledcSimRenderToWav(const char* path, void (*scenario)(void* user), void* user) {
+    sim_clock_mode_t previous = simClockGetMode();
+    simClockSetMode(SIM_CLOCK_VIRTUAL);
+    ensure_audio_initialized(); // 虚拟时间下只初始化渲染状态，不打开音频设备
+    if (!ledcSimStartWavCapture(path)) {
+        simClockSetMode(previous);
+        return false;
+    }
+    scenario(user);
+    simClockSleepMs(WAV_CAPTURE_TAIL_MS);
+    ledcSimStopWavCapture();
+    simClockSetMode(previous);
+    return true;
+}
+
+void ledcSimSetBackend(ledc_sim_backend_t backend) {
+    g_audio_backend.store((int)backend);
+    if (g_audio_initialized) {
+        // 重新打开设备；已附加的通道和命令队列保持不变
+        ma_device_uninit(&g_audio_device);
+        g_audio_initialized = false;
+        ensure_audio_initialized();
+    }
+}
+
+ledc_sim_backend_t ledcSimGetBackend(void) {
+    return (ledc_sim_backend_t)g_audio_backend.load();
+}
+
+bool ledcSimStartCapture(uint32_t capacity_frames) {
+    uint32_t capacity = 1;
+    while (capacity < capacity_frames && capacity < (1u << 30)) capacity <<= 1;
+    float* data = new (std::nothrow) float[capacity];
+    if (!data) {
+        log_e("ledcSimStartCapture: Failed to allocate %u frames", capacity);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    delete[] g_capture.data;
+    g_capture.data = data;
+    g_capture.capacity = capacity;
+    g_capture.head.store(0);
+    g_capture.tail.store(0);
+    g_capture.dropped.store(0);
+    return true;
+}
+
+void ledcSimStopCapture(void) {
+    std::lock_guard<std::mutex> lock(g_render_mutex);
+    delete[] g_capture.data;
+    g_capture.data = NULL;
+    g_capture.capacity = 0;
+}
+
+uint32_t ledcSimReadCapture(float* dst, uint32_t max_frames) {
+    CaptureRing& ring = g_capture;
+    if (!ring.data) return 0;
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint32_t available = ring.head.load(std::memory_order_acquire) - tail;
+    uint32_t count = available < max_frames ? available : max_frames;
+    uint32_t offset = tail & (ring.capacity - 1);
+    uint32_t first = std::min(count, ring.capacity - offset);
+    memcpy(dst, ring.data + offset, first * sizeof(float));
+    memcpy(dst + first, ring.data, (count - first) * sizeof(float));
+    ring.tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+uint32_t ledcSimGetCaptureAvailable(void) {
+    if (!g_capture.data) return 0;
+    return g_capture.head.load(std::memory_order_acquire) - g_capture.tail.load(std::memory_order_relaxed);
+}
+
+uint64_t ledcSimGetCaptureDropped(void) {
+    return g_capture.dropped.load(std::memory_order_relaxed);
+}
+
+// Goertzel 算法：求信号在某一频率上的幅度
+static double goertzel_magnitude(const float* x, size_t n, double freq, double sampleRate) {
+    double coeff = 2.0 * std::cos(2.0 * M_PI * freq / sampleRate);
+    double s1 = 0.0, s2 = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double s0 = x[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return std::sqrt(s1 * s1 + s2 * s2 - coeff * s1 * s2) / (double)n;
+}
+
+void ledcSimRunOscillatorBenchmark(uint32_t freq, double seconds) {
+    const double sampleRate = SIM_SAMPLE_RATE;
+    const char* names[] = { "naive", "polyblep", "blep-table" };
+    const size_t total = (size_t)(seconds * sampleRate);
+    LedcTimerConfig cfg;
+    if (total == 0 || !ledc_calc_timer(freq, 10, &cfg)) return;
+    // 分频取整后的实际频率，探测混叠时必须用它而不是请求的频率
+    const double actual = (double)cfg.phase_increment * sampleRate / 4294967296.0;
+
+    init_blep_table();
+
+    // 找一个低于基频、且不是谐波的混叠频率作为探测点（奇次谐波折叠后的位置）
+    double probe = 0.0;
+    for (int k = 3; k < 200; k += 2) {
+        double a = std::fmod((double)k * actual, sampleRate);
+        if (a > sampleRate / 2) a = sampleRate - a;
+        if (a > 20.0 && a < 0.9 * actual) { probe = a; break; }
+    }
+
+    std::vector<float> out(total);
+    std::vector<float> mix(RENDER_CHUNK_FRAMES + 2 * BLEP_HALF_TAPS);
+    printf("[SIM_LEDC] Oscillator benchmark: %u Hz square, %.1f s @ %.0f Hz\n", freq, seconds, sampleRate);
+    for (int mode = LEDC_SIM_OSC_NAIVE; mode <= LEDC_SIM_OSC_BLEP_TABLE; ++mode) {
+        LedcRenderState st;
+        memset(&st, 0, sizeof(st));
+        st.increment[0] = cfg.phase_increment;
+        st.threshold[0] = 0x80000000u;
+        st.gain[0] = CHANNEL_AMPLITUDE;
+        st.active_mask = 1;
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t done = 0; done < total; ) {
+            uint32_t frames = (uint32_t)std::min<size_t>(total - done, RENDER_CHUNK_FRAMES);
+            g_mix_kernel(st, 1, mix.data(), frames, mode);
+            flush_mix_buffer(mix.data(), out.data() + done, frames);
+            done += frames;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+        double fundamental = goertzel_magnitude(out.data(), total, actual, sampleRate);
+        double alias = probe > 0.0 ? goertzel_magnitude(out.data(), total, probe, sampleRate) : 0.0;
+        double alias_db = (alias > 0.0 && fundamental > 0.0) ? 20.0 * std::log10(alias / fundamental) : -200.0;
+        printf("  %-10s %7.2f ns/sample  %8.1fx realtime  alias@%.0fHz %7.1f dB\n",
+               names[mode], ns / total, (seconds * 1e9) / ns, probe, alias_db);
+    }
+
+    // 16 个通道同时发声时各混音内核的速度（PolyBLEP）
+    struct { const char* name; MixKernel kernel; } kernels[] = {
+        { "scalar", mix_kernel_scalar },
+#ifdef LEDC_SIM_X86_KERNELS
+        { "sse2", __builtin_cpu_supports("sse2") ? mix_kernel_sse2 : NULL },
+        { "avx2", __builtin_cpu_supports("avx2") ? mix_kernel_avx2 : NULL },
+#endif
+    };
+    printf("[SIM_LEDC] Mixer benchmark: %d channels, polyblep\n", NUM_LEDC_CHANNELS);
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (!kernels[k].kernel) continue;
+        LedcRenderState st;
+        for (int ch = 0; ch < NUM_LEDC_CHANNELS; ++ch) {
+            st.phase[ch] = 0;
+            st.increment[ch] = cfg.phase_increment + (uint32_t)ch * (cfg.phase_increment / 16);
+            st.threshold[ch] = 0x80000000u;
+            st.gain[ch] = CHANNEL_AMPLITUDE / NUM_LEDC_CHANNELS;
+        }
+        st.active_mask = (1u << NUM_LEDC_CHANNELS) - 1;
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t done = 0; done < total; ) {
+            uint32_t frames = (uint32_t)std::min<size_t>(total - done, RENDER_CHUNK_FRAMES);
+            kernels[k].kernel(st, NUM_LEDC_CHANNELS, mix.data(), frames, LEDC_SIM_OSC_POLYBLEP);
+            flush_mix_buffer(mix.data(), out.data() + done, frames);
+            done += frames;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        printf("  %-10s %7.2f ns/sample  %8.1fx realtime%s\n", kernels[k].name, ns / total, (seconds * 1e9) / ns,
+               kernels[k].kernel == g_mix_kernel ? "  (selected)" : "");
+    }
+
+    // 逐采样与跳变沿列表两种渲染方式的对比（4 个通道，PolyBLEP），并核对两者输出是否一致
+    const uint32_t test_freqs[] = { 110, 440, freq };
+    std::vector<float> reference(total);
+    printf("[SIM_LEDC] Renderer benchmark: 4 channels, polyblep\n");
+    for (size_t f = 0; f < sizeof(test_freqs) / sizeof(test_freqs[0]); ++f) {
+        LedcTimerConfig tone;
+        if (!ledc_calc_timer(test_freqs[f], 10, &tone)) continue;
+        double per_sample_ns = 0.0;
+        for (int edge_list = 0; edge_list <= 1; ++edge_list) {
+            LedcRenderState st;
+            memset(&st, 0, sizeof(st));
+            for (int ch = 0; ch < 4; ++ch) {
+                st.increment[ch] = tone.phase_increment + (uint32_t)ch * (tone.phase_increment / 5);
+                st.threshold[ch] = 0x80000000u;
+                st.gain[ch] = CHANNEL_AMPLITUDE / 4;
+            }
+            st.active_mask = 0xF;
+            std::fill(mix.begin(), mix.end(), 0.0f);
+            std::vector<float>& dst = edge_list ? out : reference;
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t done = 0; done < total; ) {
+                uint32_t frames = (uint32_t)std::min<size_t>(total - done, RENDER_CHUNK_FRAMES);
+                if (edge_list) {
+                    mix_edge_list(st, 4, mix.data(), frames, LEDC_SIM_OSC_POLYBLEP);
+                } else {
+                    g_mix_kernel(st, 4, mix.data(), frames, LEDC_SIM_OSC_POLYBLEP);
+                }
+                flush_mix_buffer(mix.data(), dst.data() + done, frames);
+                done += frames;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+            if (!edge_list) {
+                per_sample_ns = ns;
+                printf("  %5u Hz  per-sample %7.2f ns/sample", test_freqs[f], ns / total);
+            } else {
+                float max_diff = 0.0f;
+                for (size_t i = 0; i < total; ++i) max_diff = std::max(max_diff, std::fabs(out[i] - reference[i]));
+                printf("  edge-list %7.2f ns/sample (%.1fx, max diff %.1e)\n", ns / total, per_sample_ns / ns, max_diff);
+            }
+        }
+    }
+
+    // 20kHz PWM 载波、占空比按 440Hz 正弦调制（PWM-DAC）：比较 48kHz PolyBLEP 与过采样渲染。
+    // 载波三次谐波折叠到音频带内的位置作为混叠探测点
+    LedcTimerConfig carrier;
+    if (ledc_calc_timer(20000, 10, &carrier)) {
+        const double carrier_hz = (double)carrier.phase_increment * sampleRate / 4294967296.0;
+        const double signal_hz = 440.0;
+        const uint32_t control_frames = 16; // 占空比更新间隔
+        double alias_hz = std::fmod(3.0 * carrier_hz, sampleRate);
+        if (alias_hz > sampleRate / 2) alias_hz = sampleRate - alias_hz;
+        init_halfband_filters();
+        std::unique_ptr<OversampleState> os(new OversampleState());
+        printf("[SIM_LEDC] PWM-DAC benchmark: %.0f Hz carrier, duty modulated at %.0f Hz\n", carrier_hz, signal_hz);
+        for (int oversampled = 0; oversampled <= 1; ++oversampled) {
+            LedcRenderState st;
+            memset(&st, 0, sizeof(st));
+            memset(os.get(), 0, sizeof(OversampleState));
+            st.increment[0] = carrier.phase_increment;
+            st.gain[0] = CHANNEL_AMPLITUDE;
+            st.active_mask = 1;
+            std::fill(mix.begin(), mix.end(), 0.0f);
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t done = 0; done < total; ) {
+                uint32_t frames = (uint32_t)std::min<size_t>(total - done, RENDER_CHUNK_FRAMES);
+                for (uint32_t pos = 0; pos < frames; pos += control_frames) {
+                    uint32_t segment = std::min(control_frames, frames - pos);
+                    double duty = 0.5 + 0.4 * std::sin(2.0 * M_PI * signal_hz * (double)(done + pos) / sampleRate);
+                    uint32_t threshold = (uint32_t)(duty * 4294967296.0);
+                    if (oversampled) {
+                        set_oversample_lane(*os, 0, carrier.phase_increment, threshold);
+                        mix_oversampled(*os, mix.data() + pos, segment);
+                    } else {
+                        st.threshold[0] = threshold;
+                        g_mix_kernel(st, 1, mix.data() + pos, segment, LEDC_SIM_OSC_POLYBLEP);
+                    }
+                }
+                flush_mix_buffer(mix.data(), out.data() + done, frames);
+                done += frames;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+            double signal = goertzel_magnitude(out.data(), total, signal_hz, sampleRate);
+            double alias = goertzel_magnitude(out.data(), total, alias_hz, sampleRate);
+            printf("  %-12s %7.2f ns/sample  %8.1fx realtime  alias@%.0fHz %7.1f dB\n",
+                   oversampled ? "oversampled" : "polyblep", ns / total, (seconds * 1e9) / ns, alias_hz,
+                   20.0 * std::log10(std::max(alias, 1e-12) / signal));
+        }
+    }
 }
 
 } // extern "C"
@@ -0,0 +1,310 @@
+#ifndef _ESP32_HAL_LEDC_SIM_H_
+#define _ESP32_HAL_LEDC_SIM_H_
+
+// 仅 PC 模拟器提供的扩展接口。ESP32 真机上没有这些函数，
+// 固件代码不应依赖它们；它们只用于调节/检验模拟器本身。
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp32-hal-ledc.h"
+
+// --- 振荡器类型 ---
+typedef enum {
+    LEDC_SIM_OSC_NAIVE = 0,   // 朴素方波（原始实现，高频会产生混叠）
+    LEDC_SIM_OSC_POLYBLEP,    // 多项式 BLEP，每个跳变沿修正 2 个采样
+    LEDC_SIM_OSC_BLEP_TABLE,  // 查表 BLEP（加窗 sinc 积分），每个跳变沿修正 16 个采样
+} ledc_sim_osc_t;
+
+// --- 渲染方式 ---
+typedef enum {
+    LEDC_SIM_RENDER_AUTO = 0,     // 按跳变沿密度自动选择（默认）
+    LEDC_SIM_RENDER_PER_SAMPLE,   // 逐采样推进所有通道的相位（SIMD 内核）
+    LEDC_SIM_RENDER_EDGE_LIST,    // 只计算跳变沿，沿与沿之间整段填充，适合低频和稀疏音调
+} ledc_sim_render_t;
+
+// --- 音频后端 ---
+typedef enum {
+    LEDC_SIM_BACKEND_AUTO = 0, // 优先使用系统播放设备，没有声卡时自动退回 null 后端（默认）
+    LEDC_SIM_BACKEND_DEVICE,   // 只使用系统播放设备，打开失败时保持静音
+    LEDC_SIM_BACKEND_NULL,     // null 后端：不输出声音，但仍按实时速度渲染（无头环境）
+} ledc_sim_backend_t;
+
+// --- 频率扫描曲线 ---
+typedef enum {
+    LEDC_SIM_SWEEP_LINEAR = 0,   // 频率随时间线性变化
+    LEDC_SIM_SWEEP_EXPONENTIAL,  // 频率按固定比例变化（音高线性变化，适合警报声）
+} ledc_sim_sweep_t;
+
+// --- LFO 波形 ---
+typedef enum {
+    LEDC_SIM_LFO_SINE = 0,  // 正弦：平滑的颤音
+    LEDC_SIM_LFO_TRIANGLE,  // 三角：匀速起伏的警笛声
+    LEDC_SIM_LFO_SQUARE,    // 方波：在两个音高之间交替（双音警报 / warble）
+    LEDC_SIM_LFO_SAWTOOTH,  // 锯齿：反复上滑
+} ledc_sim_lfo_t;
+
+// ledcSimPlaySequence 的一个音符
+typedef struct {
+    uint32_t frequency;   // 频率（Hz），0 表示休止符
+    uint32_t duty;        // 占空比，按引脚附加时的分辨率（例如 10 位时 512 为 50%），0 表示休止符
+    uint32_t duration_ms; // 音符时长（毫秒）
+    uint32_t gap_ms;      // 音符之后的静音（毫秒）
+} ledc_sim_note_t;
+
+// 已经换算成定时器参数和帧数的一步，由 ledc_melody.h 在编译期生成
+typedef struct {
+    uint32_t phase_increment; // SIM 采样率下每个采样的相位增量（2^32 为一个周期）
+    uint32_t duty;            // 占空比，0 表示休止符
+    uint32_t note_frames;     // 发声的帧数
+    uint32_t gap_frames;      // 之后静音的帧数
+    uint32_t divider;         // LEDC 定时器的 10.8 定点分频系数
+    uint32_t clock_hz;        // 分频前的时钟源频率
+    bool above_nyquist;       // 基频高于 SIM 采样率的一半
+} ledc_sim_melody_step_t;
+
+// ledcSimPlayMelody 播放的旋律表
+typedef struct {
+    const ledc_sim_melody_step_t* steps;
+    uint32_t count;
+    uint8_t resolution;    // 生成这张表时使用的分辨率，播放的引脚必须相同
+    uint64_t total_frames; // 播放一遍的帧数
+} ledc_sim_melody_t;
+
+// 渲染输出回调：samples 为刚渲染好的 frames 个单声道采样（SIM 采样率 48kHz）
+typedef void (*ledc_sim_output_cb_t)(const float* samples, uint32_t frames, void* user);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 选择所有通道使用的方波振荡器类型，可在播放过程中随时切换。
+ *
+ * @param mode 振荡器类型，默认 LEDC_SIM_OSC_POLYBLEP。
+ */
+void ledcSimSetOscillator(ledc_sim_osc_t mode);
+
+/**
+ * @brief 获取当前使用的振荡器类型。
+ */
+ledc_sim_osc_t ledcSimGetOscillator(void);
+
+/**
+ * @brief 选择渲染方式，可在播放过程中随时切换。两种方式的输出一致，只是开销不同。
+ *
+ * @param mode 渲染方式，默认 LEDC_SIM_RENDER_AUTO。
+ */
+void ledcSimSetRenderMode(ledc_sim_render_t mode);
+
+/**
+ * @brief 获取当前的渲染方式。
+ */
+ledc_sim_render_t ledcSimGetRenderMode(void);
+
+/**
+ * @brief 为单个通道打开或关闭过采样渲染，可在播放过程中随时切换。
+ *        打开后该通道在 16 倍采样率下生成 PWM 波形，再经 CIC 与半带滤波器抽取到输出采样率，
+ *        可以正确再现远高于音频频率的 PWM 载波（例如 20kHz 载波加占空比调制）。
+ *        只有打开过采样的通道才承担额外开销。
+ *        基频高于奈奎斯特频率的通道总是按平均电平渲染，不受此设置影响。
+ *
+ * @param channel LEDC 通道号 (0-15)。
+ * @param enable true 打开，false 关闭（默认）。
+ */
+void ledcSimSetChannelOversampling(uint8_t channel, bool enable);
+
+/**
+ * @brief 查询通道是否打开了过采样渲染。
+ */
+bool ledcSimGetChannelOversampling(uint8_t channel);
+
+/**
+ * @brief 设置通道的频率调制（颤音 / 警笛），由音频线程中的查表 LFO 计算，可在播放过程中随时修改。
+ *        调制只作用于渲染出的声音，与 ledcWriteTone、音符序列和频率扫描叠加，
+ *        ledcReadFreq 仍返回未调制的频率。设置一直保留到再次调用，不随分离通道清除。
+ *
+ * @param channel LEDC 通道号 (0-15)。
+ * @param rate_hz LFO 频率（Hz），0 关闭调制，最高 1500Hz。
+ * @param depth_cents 调制深度（音分，100 音分为一个半音），频率在 ±depth 之间变化，0 关闭调制。
+ * @param waveform LFO 波形。
+ * @return 参数无效时返回 false。
+ */
+bool ledcSimSetModulation(uint8_t channel, float rate_hz, float depth_cents, ledc_sim_lfo_t waveform);
+
+/**
+ * @brief 注册输出回调，每渲染一块音频调用一次，传 NULL 取消。
+ *        实时模式下在音频线程中调用，虚拟时间模式（见 sim_clock.h）下在推进时钟的线程中调用。
+ *        回调中不能调用 ledc* 或 simClock* 函数。
+ */
+void ledcSimSetOutputCallback(ledc_sim_output_cb_t callback, void* user);
+
+/**
+ * @brief 开始把渲染输出录制到 WAV 文件（48kHz 单声道 32 位浮点），已在录制时先结束上一个文件。
+ *        实时模式下录制的是实际播放的声音，虚拟时间模式下录制的是模拟时钟驱动渲染的声音。
+ *
+ * @return 文件无法创建时返回 false。
+ */
+bool ledcSimStartWavCapture(const char* path);
+
+/**
+ * @brief 结束 WAV 录制并写好文件头。
+ */
+void ledcSimStopWavCapture(void);
+
+/**
+ * @brief 离线渲染：在虚拟时间下运行 scenario 并把声音写入 WAV 文件，不需要音频设备，
+ *        速度只受 CPU 限制。结束时额外录制 100ms 尾音，然后恢复原来的时钟模式。
+ *
+ * @param path 输出 WAV 文件路径。
+ * @param scenario 要渲染的代码，可以调用任意 tone / ledc / delay 函数。
+ * @param user 传给 scenario 的参数。
+ * @return 文件无法创建时返回 false。
+ */
+bool ledcSimRenderToWav(const char* path, void (*scenario)(void* user), void* user);
+
+/**
+ * @brief 选择音频后端。可在第一次调用 ledc* 之前设置；设备已打开时会立即按新设置重新打开，
+ *        已附加的通道不受影响。
+ */
+void ledcSimSetBackend(ledc_sim_backend_t backend);
+
+/**
+ * @brief 获取当前选择的音频后端。
+ */
+ledc_sim_backend_t ledcSimGetBackend(void);
+
+/**
+ * @brief 开始把渲染输出写入内存中的捕获缓冲区（无锁环形缓冲区），供测试读取验证。
+ *        缓冲区在这里一次性分配，已在捕获时会清空重新开始。读取跟不上时新数据被丢弃并计数。
+ *
+ * @param capacity_frames 缓冲区容量（帧），向上取整到 2 的幂。
+ * @return 内存分配失败时返回 false。
+ */
+bool ledcSimStartCapture(uint32_t capacity_frames);
+
+/**
+ * @brief 停止捕获并释放缓冲区。不能与 ledcSimReadCapture 同时调用。
+ */
+void ledcSimStopCapture(void);
+
+/**
+ * @brief 从捕获缓冲区读取最多 max_frames 帧，返回实际读取的帧数。同一时间只能有一个读取线程。
+ */
+uint32_t ledcSimReadCapture(float* dst, uint32_t max_frames);
+
+/**
+ * @brief 捕获缓冲区中可读取的帧数。
+ */
+uint32_t ledcSimGetCaptureAvailable(void);
+
+/**
+ * @brief 自 ledcSimStartCapture 以来因缓冲区满而丢弃的帧数。
+ */
+uint64_t ledcSimGetCaptureDropped(void);
+
+/**
+ * @brief ledcWriteNote 使用的音符频率表：第 8 八度的整数频率按八度右移。
+ *        其他需要与 ledcWriteNote 发出相同音高的代码（例如 RTTTL 播放器）也使用它。
+ *
+ * @return 频率（Hz），音符或八度（0-8）无效时返回 0。
+ */
+uint32_t ledcSimNoteFrequency(note_t note, uint8_t octave);
+
+/**
+ * @brief 供 tone() 实现使用：在引脚当前的通道上播放一个由渲染器计时的音符。
+ *        音符从该通道上一个门控音符结束的那一帧开始（没有时立即开始），
+ *        渲染器数满 duration_ms 对应的帧数后在那一帧静音，时长不受线程延时精度影响。
+ *
+ * @param freq 频率（Hz），0 表示一段静音。
+ * @param duration_ms 时长（毫秒），0 表示一直播放到下一个音符或通道分离。
+ * @return 音符序号，用于 ledcSimWaitToneGate；引脚未附加时返回 0。
+ */
+uint32_t ledcSimWriteToneGated(uint8_t pin, uint32_t freq, uint32_t duration_ms);
+
+/**
+ * @brief 在已附加的引脚上一次提交一整串音符，由音频线程逐帧切换，不再占用调用线程。
+ *        序列按门控音符处理：接在该通道上一个门控音符之后开始，播完、被 ledcSimStopSequence 取消、
+ *        被该通道上的其他 ledc 命令取代或通道分离时结束。音符数据在调用时复制，调用后即可释放。
+ *
+ * @param notes 音符数组。
+ * @param count 音符个数。
+ * @param repeat 播放次数，0 表示无限循环直到取消。
+ * @return 序列的序号，可用 ledcSimWaitToneGate 等待它结束；参数无效时返回 0。
+ */
+uint32_t ledcSimPlaySequence(uint8_t pin, const ledc_sim_note_t* notes, uint32_t count, uint32_t repeat);
+
+/**
+ * @brief 与 ledcSimPlaySequence 相同，但旋律表已在编译期换算好（见 ledc_melody.h 的 LEDC_MELODY），
+ *        这里不做任何解析或换算，表本身直接交给音频线程，播放期间必须保持有效。
+ *
+ * @param melody 旋律表，分辨率必须与引脚附加时的分辨率相同。
+ * @param repeat 播放次数，0 表示无限循环直到取消。
+ * @return 序列的序号，可用 ledcSimWaitToneGate 等待它结束；参数无效时返回 0。
+ */
+uint32_t ledcSimPlayMelody(uint8_t pin, const ledc_sim_melody_t* melody, uint32_t repeat);
+
+/**
+ * @brief PWM-DAC：以 sample_rate 把 duties 依次写成引脚的占空比，相当于在定时器中断里每个采样调用一次 ledcWrite，
+ *        用于模拟用 LEDC 播放语音提示的板子。采样在调用时复制，整块交给音频线程，每个采样在它的时刻生效，不会丢失更新。
+ *        载波频率高于 24kHz 时（PWM-DAC 的常规用法）渲染滤除载波后的平均电平，采样的切换精确到帧内的位置；
+ *        载波可闻时在最接近的帧切换占空比。
+ *        采样块按门控音符处理：接在该通道上一个门控音符或采样块之后开始，所以分块连续提交即可无缝播放任意长的音频
+ *        （块长不是整帧时，余数带到下一块，块之间不会累积误差）。块播完后通道静音，ledcSimStopSequence 或该通道上的其他 ledc 命令会取消它。
+ *
+ * @param duties 占空比，按引脚附加时的分辨率（例如 8 位时 128 为零电平）。
+ * @param count 采样数。
+ * @param sample_rate 采样率（Hz），不超过 48000。
+ * @return 采样块的序号，可用 ledcSimWaitToneGate 等待它播完；参数无效或引脚未附加时返回 0。
+ */
+uint32_t ledcSimWriteSamples(uint8_t pin, const uint32_t* duties, uint32_t count, uint32_t sample_rate);
+
+/**
+ * @brief 在已附加的引脚上以 50% 占空比从 start_freq 平滑扫描到 end_freq，结束后静音。
+ *        频率由音频线程每 16 个采样更新一次，调用线程只提交一条命令。
+ *        扫描按门控音符处理：接在该通道上一个门控音符之后开始，连续调用可以无缝拼接出警报声；
+ *        可用 ledcSimWaitToneGate 等待它结束，ledcSimStopSequence 或该通道上的其他 ledc 命令会取消它。
+ *
+ * @param duration_ms 扫描时长（毫秒）。
+ * @param curve 扫描曲线。
+ * @return 扫描的序号；引脚未附加或频率无法产生时返回 0。
+ */
+uint32_t ledcSimSweep(uint8_t pin, uint32_t start_freq, uint32_t end_freq, uint32_t duration_ms, ledc_sim_sweep_t curve);
+
+/**
+ * @brief 取消引脚上正在播放或等待开始的序列（包括频率扫描）并静音，引脚保持附加。
+ */
+bool ledcSimStopSequence(uint8_t pin);
+
+/**
+ * @brief 等待序号为 serial 的门控音符或序列结束（时长用完、被下一个音符取代或通道分离）。
+ *        实时模式下由音频线程在渲染到结束帧时唤醒。deadline_ns 传 0 可以只查询不等待。
+ *
+ * @param deadline_ns 最长等待到的时间（simClockNowNs 的时间基准），SIM_CLOCK_FOREVER 表示不限。
+ * @return 音符已结束返回 true，超时返回 false。
+ */
+bool ledcSimWaitToneGate(uint8_t pin, uint32_t serial, uint64_t deadline_ns);
+
+/**
+ * @brief 让调用线程之后的 ledc 调用在 time_ns 时刻生效，而不是立即生效；传 0 恢复立即生效。
+ *        命令照常提交，由渲染器在对应的帧执行，不受调用线程唤醒抖动的影响，适合提前一段时间提交事件的播放器。
+ *        引脚的寄存器状态（ledcRead、ledcReadFreq 等）仍在调用时更新。
+ *        同一通道上的命令应按时间先后提交；已经过去的时刻按立即生效处理。
+ *
+ * @param time_ns 生效时间（simClockNowNs 的时间基准）。
+ */
+void ledcSimScheduleAt(uint64_t time_ns);
+
+/**
+ * @brief 离线比较各振荡器的渲染速度与混叠程度，结果打印到标准输出。
+ *        使用独立的通道状态渲染，不影响正在播放的声音。
+ *
+ * @param freq 测试方波的频率（Hz）。
+ * @param seconds 每种振荡器渲染的音频时长（秒）。
+ */
+void ledcSimRunOscillatorBenchmark(uint32_t freq, double seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_LEDC_SIM_H_ */
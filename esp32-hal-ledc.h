@@ -9,6 +9,7 @@
 // 模拟日志宏
 #define log_d(format, ...) printf("[SIM_D] " format "\n", ##__VA_ARGS__)
 #define log_e(format, ...) printf("[SIM_E] " format "\n", ##__VA_ARGS__)
+#define log_w(format, ...) printf("[SIM_W] " format "\n", ##__VA_ARGS__)
 #define log_v(format, ...) printf("[SIM_V] " format "\n", ##__VA_ARGS__)
 
 // --- 模拟 ledc_types.h ---
@@ -36,14 +37,15 @@ uint32_t ledcRead(uint8_t pin);
 uint32_t ledcReadFreq(uint8_t pin);
 bool ledcDetach(uint8_t pin);
 uint32_t ledcChangeFrequency(uint8_t pin, uint32_t freq, uint8_t resolution);
+// 占空比渐变由音频线程逐子块计算，调用立即返回；回调在模拟的中断线程中执行
+bool ledcFade(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms);
+bool ledcFadeWithInterrupt(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms, void (*userFunc)(void));
+bool ledcFadeWithInterruptArg(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms, void (*userFunc)(void *), void *arg);
 
 // 提供空实现或默认返回值
 inline bool ledcSetClockSource(ledc_clk_cfg_t source) { (void)source; return true; }
 inline ledc_clk_cfg_t ledcGetClockSource(void) { return LEDC_AUTO_CLK; }
 inline bool ledcOutputInvert(uint8_t pin, bool out_invert) { (void)pin; (void)out_invert; return true; }
-inline bool ledcFade(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms) { (void)pin; (void)start_duty; (void)target_duty; (void)max_fade_time_ms; return false; }
-inline bool ledcFadeWithInterrupt(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms, void (*userFunc)(void)) { (void)pin; (void)start_duty; (void)target_duty; (void)max_fade_time_ms; (void)userFunc; return false; }
-inline bool ledcFadeWithInterruptArg(uint8_t pin, uint32_t start_duty, uint32_t target_duty, int max_fade_time_ms, void (*userFunc)(void *), void *arg) { (void)pin; (void)start_duty; (void)target_duty; (void)max_fade_time_ms; (void)userFunc; (void)arg; return false; }
 
 #ifdef __cplusplus
 }
@@ -1,32 +1,285 @@
+// 编译时定义 SIM_TONE_FREERTOS 时改用与真机相同的 FreeRTOS 实现（esp32_tone_freertos.cpp）
+#ifndef SIM_TONE_FREERTOS
+
 #include "esp32_tone_api.h"
 #include "esp32-hal-ledc.h"
-#include <thread>
-#include <chrono>
+#include "esp32-hal-ledc-sim.h"
+#include "sim_clock.h"
 #include <stdio.h> // For printf used in log_d
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// PC 模拟的 `tone` API 实现，语义与 arduino-esp32 一致：
+// tone() 把请求放进引脚的队列后立即返回，声音在时长结束时自动停止。
+// 音符的起止由渲染器按帧计时（ledcSimWriteToneGated）：tone() 直接把音符交给渲染器，
+// 排队的音符在渲染器里首尾相接，时长精确到帧，与线程何时被唤醒无关。
+// 真机上的 FreeRTOS 任务（见 esp32_tone_freertos.cpp）在这里只剩簿记工作：所有引脚共用一个调度线程，
+// 每个引脚有一个有界请求队列，队首音符的预计结束时刻挂在时间轮上，
+// 到期时释放队列空位，队列播完后等渲染器确认音符结束再分离引脚。
+// 等待都经由模拟时钟，虚拟时间模式下同样不占用实际时间。
+
+#define TONE_MAX_PINS      256
+#define TONE_QUEUE_LENGTH  32         // 每个引脚最多排队的请求数，队列满时 tone() 阻塞等待空位
+#define TONE_WHEEL_SLOTS   1024       // 时间轮槽数
+#define TONE_WHEEL_TICK_NS 1000000ull // 每槽 1ms，转一圈约 1 秒
+#define TONE_RESOLUTION    10         // 我们假设分辨率总是10位
+#define TONE_GATE_TIMEOUT_NS 1000000000ull // 分离引脚前等待渲染器确认的最长时间
+
+// 已交给渲染器的音符
+struct ToneNote {
+    uint32_t serial; // ledcSimWriteToneGated 返回的序号
+    uint64_t end_ns; // 预计结束时刻，SIM_CLOCK_FOREVER 表示一直播放到下一个请求
+};
+
+struct TonePin {
+    ToneNote queue[TONE_QUEUE_LENGTH + 1]; // 正在播放的音符 + 排队的请求
+    uint32_t head;
+    uint32_t count;
+    bool attached;        // 调度器已附加该引脚
+    bool timed;           // 队首音符有时长，结束时刻挂在时间轮上
+    uint64_t deadline_ns; // 队首音符的结束时刻
+    TonePin* wheel_next;  // 时间轮槽内的双向链表
+    TonePin** wheel_prev; // 指向前一节点的 wheel_next，便于 O(1) 摘除
+    uint8_t pin;
+    std::vector<SimClockWaiter*> blocked; // 因队列满而等待的调用者
+};
 
-// 这是一个简化的、仅用于PC模拟的 `tone` API 实现。
-// 它提供了与ESP32相同的API，但内部直接调用我们模拟的 `ledc` 函数，
-// 而不使用FreeRTOS的任务和队列。
+static std::mutex g_tone_mutex;
+static TonePin* g_tone_pins[TONE_MAX_PINS];
+static TonePin* g_tone_wheel[TONE_WHEEL_SLOTS];
+static uint32_t g_tone_timer_count = 0;
+static uint64_t g_tone_wheel_tick = 0; // 上次处理到的时间轮刻度，之前的槽里只会剩下已过期的音符
+static SimClockWaiter* g_tone_waiter = nullptr;
+static bool g_tone_stop = false;
+
+// --- 时间轮 ---
+
+static void wheel_insert(TonePin* p) {
+    TonePin** slot = &g_tone_wheel[(p->deadline_ns / TONE_WHEEL_TICK_NS) % TONE_WHEEL_SLOTS];
+    p->wheel_next = *slot;
+    p->wheel_prev = slot;
+    if (*slot) (*slot)->wheel_prev = &p->wheel_next;
+    *slot = p;
+    ++g_tone_timer_count;
+}
+
+static void wheel_remove(TonePin* p) {
+    *p->wheel_prev = p->wheel_next;
+    if (p->wheel_next) p->wheel_next->wheel_prev = p->wheel_prev;
+    p->wheel_next = nullptr;
+    p->wheel_prev = nullptr;
+    --g_tone_timer_count;
+}
+
+// 最早到期的音符。从上次处理到的刻度开始逐槽查找，第一个含有本圈（或更早）音符的槽即包含最小期限；
+// 一整圈都没有时说明所有音符都在一秒以后，退回全表比较。
+static TonePin* wheel_earliest() {
+    if (g_tone_timer_count == 0) return nullptr;
+    TonePin* best = nullptr;
+    for (uint32_t i = 0; i < TONE_WHEEL_SLOTS; ++i) {
+        uint64_t slot_end = (g_tone_wheel_tick + i + 1) * TONE_WHEEL_TICK_NS;
+        for (TonePin* p = g_tone_wheel[(g_tone_wheel_tick + i) % TONE_WHEEL_SLOTS]; p; p = p->wheel_next) {
+            if (p->deadline_ns < slot_end && (!best || p->deadline_ns < best->deadline_ns)) best = p;
+        }
+        if (best) return best;
+    }
+    for (uint32_t i = 0; i < TONE_WHEEL_SLOTS; ++i) {
+        for (TonePin* p = g_tone_wheel[i]; p; p = p->wheel_next) {
+            if (!best || p->deadline_ns < best->deadline_ns) best = p;
+        }
+    }
+    return best;
+}
+
+// --- 引脚状态 ---
+
+static TonePin* get_pin_locked(uint8_t pin) {
+    TonePin* p = g_tone_pins[pin];
+    if (!p) {
+        p = new TonePin();
+        p->head = 0;
+        p->count = 0;
+        p->attached = false;
+        p->timed = false;
+        p->deadline_ns = 0;
+        p->wheel_next = nullptr;
+        p->wheel_prev = nullptr;
+        p->pin = pin;
+        g_tone_pins[pin] = p;
+    }
+    return p;
+}
+
+// 队列有空位了，唤醒所有等待的调用者，由它们重新检查
+static void wake_blocked_locked(TonePin* p) {
+    for (SimClockWaiter* waiter : p->blocked) {
+        simClockWaiterNotify(waiter);
+    }
+    p->blocked.clear();
+}
+
+static void stop_pin_locked(TonePin* p) {
+    if (p->timed) {
+        wheel_remove(p);
+        p->timed = false;
+    }
+    p->head = 0;
+    p->count = 0;
+    if (p->attached) {
+        ledcWriteTone(p->pin, 0);
+        ledcDetach(p->pin); // 渲染器同时丢弃尚未开始的音符
+        p->attached = false;
+    }
+}
 
-// 辅助函数，用于在PC上实现延时
-static void simple_delay(unsigned long ms) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+static ToneNote& last_note(TonePin* p) {
+    return p->queue[(p->head + p->count - 1) % (TONE_QUEUE_LENGTH + 1)];
+}
+
+// 队首换成了新的音符：有时长的挂到时间轮上
+static void arm_head_locked(TonePin* p) {
+    const ToneNote& head = p->queue[p->head];
+    if (p->count > 0 && head.end_ns != SIM_CLOCK_FOREVER) {
+        p->deadline_ns = head.end_ns;
+        p->timed = true;
+        wheel_insert(p);
+    }
+}
+
+// 队列播完后等渲染器确认最后一个音符结束再分离引脚，调用时持有 lock，期间会暂时释放
+static void release_pin(std::unique_lock<std::mutex>& lock, TonePin* p, uint32_t serial) {
+    lock.unlock();
+    ledcSimWaitToneGate(p->pin, serial, simClockNowNs() + TONE_GATE_TIMEOUT_NS);
+    lock.lock();
+    // 等待期间可能又有新的请求，或者已被 noTone 释放
+    if (p->count == 0 && p->attached) {
+        // 模拟器里由调度器附加的引脚在队列播完后释放，避免长时间运行时耗尽通道
+        ledcDetach(p->pin);
+        p->attached = false;
+    }
+}
+
+// 处理所有在 now_ns 之前到期的音符
+static void expire_locked(std::unique_lock<std::mutex>& lock, uint64_t now_ns) {
+    uint64_t now_tick = now_ns / TONE_WHEEL_TICK_NS;
+    if (now_tick < g_tone_wheel_tick) g_tone_wheel_tick = now_tick; // 切换时钟模式后时间从零开始
+    TonePin* p;
+    while ((p = wheel_earliest()) != nullptr && p->deadline_ns <= now_ns) {
+        wheel_remove(p);
+        p->timed = false;
+        g_tone_wheel_tick = p->deadline_ns / TONE_WHEEL_TICK_NS;
+        uint32_t serial = p->queue[p->head].serial;
+        p->head = (p->head + 1) % (TONE_QUEUE_LENGTH + 1);
+        --p->count;
+        wake_blocked_locked(p);
+        if (p->count > 0) {
+            arm_head_locked(p); // 渲染器已经在播放它了
+        } else {
+            release_pin(lock, p, serial);
+        }
+    }
+    if (now_tick > g_tone_wheel_tick) g_tone_wheel_tick = now_tick;
+}
+
+// --- 调度线程 ---
+
+static void tone_scheduler_main() {
+    std::unique_lock<std::mutex> lock(g_tone_mutex);
+    while (!g_tone_stop) {
+        expire_locked(lock, simClockNowNs());
+        TonePin* next = wheel_earliest();
+        uint64_t deadline = next ? next->deadline_ns : SIM_CLOCK_FOREVER;
+        lock.unlock();
+        simClockWaiterWait(g_tone_waiter, deadline);
+        lock.lock();
+    }
+    lock.unlock();
+    simClockThreadEnd();
+}
+
+// 调度线程在第一次调用 tone() 时启动，程序退出时停止
+struct ToneScheduler {
+    std::thread thread;
+
+    ~ToneScheduler() {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(g_tone_mutex);
+            g_tone_stop = true;
+        }
+        simClockWaiterNotify(g_tone_waiter);
+        thread.join();
+    }
+};
+
+static ToneScheduler g_tone_scheduler;
+static std::once_flag g_tone_scheduler_once;
+
+static void ensure_scheduler_started() {
+    std::call_once(g_tone_scheduler_once, [] {
+        g_tone_waiter = simClockWaiterCreate();
+        simClockThreadBegin(); // 在创建线程之前登记，虚拟时间不会在线程启动前推进
+        g_tone_scheduler.thread = std::thread(tone_scheduler_main);
+    });
 }
 
 void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
-    // 附加引脚并设置频率。我们假设分辨率总是10位。
-    ledcAttach(pin, frequency, 10);
-    ledcWriteTone(pin, frequency);
+    ensure_scheduler_started();
 
-    if (duration > 0) {
-        simple_delay(duration);
-        noTone(pin); // 播放完成后调用 noTone
+    std::unique_lock<std::mutex> lock(g_tone_mutex);
+    TonePin* p = get_pin_locked(pin);
+    while (p->count > TONE_QUEUE_LENGTH) {
+        // 与真机 xQueueSend(portMAX_DELAY) 一样，队列满时等待调度器取走一个请求
+        SimClockWaiter* waiter = simClockWaiterCreate();
+        p->blocked.push_back(waiter);
+        lock.unlock();
+        simClockWaiterWait(waiter, SIM_CLOCK_FOREVER);
+        lock.lock();
+        for (size_t i = 0; i < p->blocked.size(); ++i) {
+            if (p->blocked[i] == waiter) {
+                p->blocked.erase(p->blocked.begin() + i);
+                break;
+            }
+        }
+        simClockWaiterDestroy(waiter);
+    }
+
+    uint64_t start_ns = simClockNowNs();
+    if (p->count > 0) {
+        if (last_note(p).end_ns == SIM_CLOCK_FOREVER) {
+            --p->count; // 没有时长的音符在下一个请求到来时结束，渲染器里同样被新音符取代
+        } else {
+            start_ns = last_note(p).end_ns; // 接在前一个音符后面，与渲染器里的衔接一致
+        }
+    }
+    if (!p->attached) {
+        if (!ledcAttach(pin, frequency, TONE_RESOLUTION)) {
+            log_e("Tone start failed on pin %d", pin);
+            return;
+        }
+        p->attached = true;
+    }
+    ToneNote note;
+    note.serial = ledcSimWriteToneGated(pin, frequency, duration); // 频率 0 即一段静音
+    note.end_ns = duration > 0 ? start_ns + (uint64_t)duration * 1000000u : SIM_CLOCK_FOREVER;
+    p->queue[(p->head + p->count) % (TONE_QUEUE_LENGTH + 1)] = note;
+    if (++p->count == 1) {
+        arm_head_locked(p);
+        lock.unlock();
+        simClockWaiterNotify(g_tone_waiter); // 调度线程重新计算最早的期限
     }
 }
 
 void noTone(uint8_t pin) {
-    ledcWriteTone(pin, 0); // 停止声音
-    ledcDetach(pin);       // 释放引脚资源
+    std::lock_guard<std::mutex> lock(g_tone_mutex);
+    TonePin* p = g_tone_pins[pin];
+    // 与真机一样只处理由 tone() 附加的引脚，直接用 ledc 附加的引脚不受影响
+    if (p && p->attached) {
+        // 丢弃尚未播放的请求并取消当前音符
+        stop_pin_locked(p);
+        wake_blocked_locked(p);
+    }
 }
 
 void setToneChannel(uint8_t channel) {
@@ -34,4 +287,6 @@ void setToneChannel(uint8_t channel) {
     // 这个函数可以保留为空，以保持API兼容性。
     (void)channel;
     log_d("setToneChannel(%d) called, but is a no-op in this simplified simulator.", channel);
-}
\ No newline at end of file
+}
+
+#endif // SIM_TONE_FREERTOS
@@ -0,0 +1,121 @@
+// 与 arduino-esp32 真机相同的 `tone` API 实现：所有请求经由一个 FreeRTOS 队列交给单独的任务，
+// 任务附加引脚、用 ledcWriteTone 发声，并用 vTaskDelay 为有时长的音符计时。
+// 编译时定义 SIM_TONE_FREERTOS（make TONE_FREERTOS=1）即用它取代 esp32_tone_api.cpp 中的模拟器实现，
+// 借助 FreeRTOS 模拟层（freertos_sim.cpp）在 PC 上运行实际发布的代码路径；
+// 虚拟时间模式下任务的延时同样只推进模拟时钟，可以快速、可重复地运行。
+#ifdef SIM_TONE_FREERTOS
+
+#include "esp32_tone_api.h"
+#include "esp32-hal-ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <atomic>
+
+#define TONE_QUEUE_LENGTH  128
+#define TONE_TASK_STACK    3500 // 字
+#define TONE_RESOLUTION    10
+#define TONE_MAX_CHANNELS  16
+#define TONE_NO_CHANNEL    255  // 没有调用 setToneChannel 时自动选择通道
+
+static TaskHandle_t g_tone_task = NULL;
+static QueueHandle_t g_tone_queue = NULL;
+static std::atomic<int> g_tone_pin(-1); // 正在使用的引脚，只由任务修改
+static uint8_t g_tone_channel = TONE_NO_CHANNEL;
+
+typedef enum {
+    TONE_START,
+    TONE_END,
+} tone_cmd_t;
+
+typedef struct {
+    tone_cmd_t tone_cmd;
+    uint8_t pin;
+    unsigned int frequency;
+    unsigned long duration;
+    uint8_t channel;
+} tone_msg_t;
+
+static void tone_task(void*) {
+    tone_msg_t tone_msg;
+    for (;;) {
+        xQueueReceive(g_tone_queue, &tone_msg, portMAX_DELAY);
+        switch (tone_msg.tone_cmd) {
+            case TONE_START:
+                log_d("Task received from queue TONE_START: pin=%d, frequency=%u Hz, duration=%lu ms", tone_msg.pin,
+                      tone_msg.frequency, tone_msg.duration);
+                if (g_tone_pin == -1) {
+                    bool ok = tone_msg.channel == TONE_NO_CHANNEL
+                                  ? ledcAttach(tone_msg.pin, tone_msg.frequency, TONE_RESOLUTION)
+                                  : ledcAttachChannel(tone_msg.pin, tone_msg.frequency, TONE_RESOLUTION, tone_msg.channel);
+                    if (!ok) {
+                        log_e("Tone start failed");
+                        break;
+                    }
+                    g_tone_pin = tone_msg.pin;
+                }
+                ledcWriteTone(tone_msg.pin, tone_msg.frequency);
+                if (tone_msg.duration) {
+                    vTaskDelay(pdMS_TO_TICKS(tone_msg.duration));
+                    ledcWriteTone(tone_msg.pin, 0);
+                }
+                break;
+
+            case TONE_END:
+                log_d("Task received from queue TONE_END: pin=%d", tone_msg.pin);
+                ledcWriteTone(tone_msg.pin, 0);
+                ledcDetach(tone_msg.pin);
+                g_tone_pin = -1;
+                break;
+        }
+    }
+}
+
+// 第一次调用时创建队列和任务
+static bool tone_init() {
+    if (g_tone_queue == NULL) {
+        g_tone_queue = xQueueCreate(TONE_QUEUE_LENGTH, sizeof(tone_msg_t));
+        if (g_tone_queue == NULL) {
+            log_e("Could not create tone queue");
+            return false;
+        }
+    }
+    if (g_tone_task == NULL) {
+        xTaskCreate(tone_task, "toneTask", TONE_TASK_STACK, NULL, 1, &g_tone_task);
+        if (g_tone_task == NULL) {
+            log_e("Could not create tone task");
+            return false;
+        }
+    }
+    return true;
+}
+
+void setToneChannel(uint8_t channel) {
+    if (channel >= TONE_MAX_CHANNELS) {
+        log_e("Channel %u is not available!", channel);
+        return;
+    }
+    g_tone_channel = channel;
+}
+
+void noTone(uint8_t pin) {
+    if (g_tone_pin == pin && tone_init()) {
+        tone_msg_t tone_msg = { TONE_END, pin, 0, 0, 0 };
+        xQueueReset(g_tone_queue); // 丢弃尚未播放的请求
+        xQueueSend(g_tone_queue, &tone_msg, portMAX_DELAY);
+    }
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+    int busy_pin = g_tone_pin;
+    if (busy_pin != -1 && busy_pin != pin) {
+        log_e("Tone is still running on pin %d, call noTone(%d) first!", busy_pin, busy_pin);
+        return;
+    }
+    if (tone_init()) {
+        tone_msg_t tone_msg = { TONE_START, pin, frequency, duration, g_tone_channel };
+        xQueueSend(g_tone_queue, &tone_msg, portMAX_DELAY);
+    }
+}
+
+#endif // SIM_TONE_FREERTOS
@@ -0,0 +1,33 @@
+#ifndef _SIM_FREERTOS_H_
+#define _SIM_FREERTOS_H_
+
+// PC 模拟器使用的最小 FreeRTOS 接口（实现见 freertos_sim.cpp）。
+// 只提供真机 tone() 之类代码用到的任务、延时、节拍计数和队列，
+// 每个任务是一个线程，延时和阻塞都经由模拟时钟（sim_clock.h），虚拟时间模式下同样不占用实际时间。
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t configSTACK_DEPTH_TYPE;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+#define errQUEUE_FULL  ((BaseType_t)0)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+
+#define configTICK_RATE_HZ      1000 // 与 arduino-esp32 相同，一个节拍 1ms
+#define configMAX_TASK_NAME_LEN 16
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000u))
+#define pdTICKS_TO_MS(ticks)    ((uint32_t)(((uint64_t)(ticks) * 1000u) / configTICK_RATE_HZ))
+
+// 模拟器里没有真正的中断，"中断"回调运行在普通线程中，不需要切换任务
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+#endif /* _SIM_FREERTOS_H_ */
@@ -0,0 +1,70 @@
+#ifndef _SIM_FREERTOS_QUEUE_H_
+#define _SIM_FREERTOS_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition* QueueHandle_t;
+
+#define queueSEND_TO_BACK  ((BaseType_t)0)
+#define queueSEND_TO_FRONT ((BaseType_t)1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 创建一个最多容纳 length 个、每个 item_size 字节的队列，存储空间在这里一次性分配。
+ *
+ * @return 参数无效或内存不足时返回 NULL。
+ */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+/**
+ * @brief 删除队列。调用时不能有任务在该队列上阻塞。
+ */
+void vQueueDelete(QueueHandle_t queue);
+
+/**
+ * @brief 把 item 复制进队列。队列满时最多阻塞 ticks 个节拍（经由模拟时钟，portMAX_DELAY 表示一直等待）。
+ *        一般通过下面的 xQueueSend* 宏调用。
+ *
+ * @param position queueSEND_TO_BACK 或 queueSEND_TO_FRONT。
+ * @return 成功返回 pdPASS，超时返回 errQUEUE_FULL。
+ */
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t ticks, BaseType_t position);
+
+#define xQueueSend(queue, item, ticks)        xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToBack(queue, item, ticks)  xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToFront(queue, item, ticks) xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_FRONT)
+
+/**
+ * @brief 中断中使用的发送：从不阻塞，队列满时返回 errQUEUE_FULL。
+ *        例如在 ledcFadeWithInterrupt 的回调中把事件交给任务。
+ *
+ * @param higher_priority_task_woken 总是写入 pdFALSE（可以为 NULL）。
+ */
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken);
+
+/**
+ * @brief 从队首取出一项复制到 buffer。队列空时最多阻塞 ticks 个节拍。
+ *
+ * @return 取到返回 pdPASS，超时返回 errQUEUE_EMPTY。
+ */
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks);
+
+/**
+ * @brief 清空队列，唤醒因队列满而阻塞的发送者。
+ */
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+/**
+ * @brief 队列中的项数 / 剩余空位数。
+ */
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SIM_FREERTOS_QUEUE_H_ */
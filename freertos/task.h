@@ -0,0 +1,65 @@
+#ifndef _SIM_FREERTOS_TASK_H_
+#define _SIM_FREERTOS_TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 创建任务。任务是一个独立的线程，并登记为模拟时钟的参与线程（见 simClockThreadBegin）。
+ *        模拟器没有优先级调度，栈大小和优先级只被记录；任务之间真正并行运行。
+ *
+ * @return 创建成功返回 pdPASS。
+ */
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, configSTACK_DEPTH_TYPE stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task);
+
+/**
+ * @brief 与 xTaskCreate 相同，core_id 被忽略。
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name, configSTACK_DEPTH_TYPE stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id);
+
+/**
+ * @brief 删除任务。模拟器只支持任务删除自己（传 NULL 或自己的句柄），调用后不会返回。
+ */
+void vTaskDelete(TaskHandle_t task);
+
+/**
+ * @brief 延时 ticks 个节拍，经由模拟时钟。传 0 只让出 CPU。
+ */
+void vTaskDelay(TickType_t ticks);
+
+/**
+ * @brief 延时到 *previous_wake + increment 个节拍，并把 *previous_wake 更新为该时刻，用于固定周期的循环。
+ *        已经错过该时刻时立即返回。
+ */
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t increment);
+
+/**
+ * @brief 当前节拍计数（simClockNowNs 换算成节拍，虚拟时间模式下从切换模式时的 0 开始）。
+ */
+TickType_t xTaskGetTickCount(void);
+
+/**
+ * @brief 调用者所在任务的句柄，不在任务中时返回 NULL。
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/**
+ * @brief 任务名称，传 NULL 表示调用者所在的任务。
+ */
+const char* pcTaskGetName(TaskHandle_t task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SIM_FREERTOS_TASK_H_ */
@@ -0,0 +1,235 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp32-hal-ledc.h" // For log_e
+#include "sim_clock.h"
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// PC 上的最小 FreeRTOS 实现：每个任务是一个登记为模拟时钟参与线程的线程，
+// vTaskDelay 就是 simClockSleep，队列的阻塞等待使用 simClockWaiter。
+// 因此虚拟时间模式下任务的延时不占用实际时间，时间只在所有任务都处于延时或阻塞中时才推进，
+// 只通过队列和延时交互的任务每次运行的结果逐位相同。
+// 没有优先级和抢占，任务真正并行运行；需要互斥的代码应该像在多核 ESP32 上一样使用队列。
+
+#define SIM_TICK_NS (1000000000ull / configTICK_RATE_HZ)
+
+struct tskTaskControlBlock {
+    TaskFunction_t code;
+    void* parameters;
+    char name[configMAX_TASK_NAME_LEN];
+    configSTACK_DEPTH_TYPE stack_depth; // 只记录，线程使用系统默认的栈
+    UBaseType_t priority;               // 只记录
+};
+
+// vTaskDelete(NULL) 通过异常回到任务线程的入口，在那里结束线程
+struct SimTaskExit {};
+
+static thread_local tskTaskControlBlock* t_current_task = nullptr;
+
+static void task_main(tskTaskControlBlock* task) {
+    t_current_task = task;
+    try {
+        task->code(task->parameters);
+        log_e("Task %s returned without calling vTaskDelete", task->name);
+    } catch (const SimTaskExit&) {
+    }
+    t_current_task = nullptr;
+    delete task;
+    simClockThreadEnd();
+}
+
+static uint64_t ticks_to_deadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) return SIM_CLOCK_FOREVER;
+    return simClockNowNs() + (uint64_t)ticks * SIM_TICK_NS;
+}
+
+extern "C" {
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, configSTACK_DEPTH_TYPE stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task) {
+    tskTaskControlBlock* task = new (std::nothrow) tskTaskControlBlock();
+    if (task == nullptr || task_code == nullptr) {
+        delete task;
+        return pdFAIL;
+    }
+    task->code = task_code;
+    task->parameters = parameters;
+    strncpy(task->name, name ? name : "", configMAX_TASK_NAME_LEN - 1);
+    task->name[configMAX_TASK_NAME_LEN - 1] = '\0';
+    task->stack_depth = stack_depth;
+    task->priority = priority;
+    if (created_task) *created_task = task;
+    simClockThreadBegin(); // 在创建线程之前登记，虚拟时间不会在任务启动前推进
+    std::thread(task_main, task).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name, configSTACK_DEPTH_TYPE stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id) {
+    (void)core_id;
+    return xTaskCreate(task_code, name, stack_depth, parameters, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (t_current_task == nullptr || (task != nullptr && task != t_current_task)) {
+        log_e("vTaskDelete: only a task deleting itself is supported in the simulator.");
+        return;
+    }
+    throw SimTaskExit();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    simClockSleepNs((uint64_t)ticks * SIM_TICK_NS);
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t increment) {
+    uint64_t now_ns = simClockNowNs();
+    TickType_t now = (TickType_t)(now_ns / SIM_TICK_NS);
+    *previous_wake += increment;
+    int32_t ahead = (int32_t)(*previous_wake - now);
+    if (ahead > 0) {
+        // 延时到目标节拍开始的时刻，而不是从现在起整数个节拍
+        simClockSleepNs((uint64_t)ahead * SIM_TICK_NS - now_ns % SIM_TICK_NS);
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(simClockNowNs() / SIM_TICK_NS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return t_current_task;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    if (task == nullptr) task = t_current_task;
+    return task ? task->name : "main";
+}
+
+} // extern "C"
+
+// --- 队列 ---
+
+struct QueueDefinition {
+    std::mutex mutex;
+    std::vector<uint8_t> storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    std::vector<SimClockWaiter*> receivers; // 因队列空而阻塞的任务
+    std::vector<SimClockWaiter*> senders;   // 因队列满而阻塞的任务
+};
+
+// 队列状态变了，唤醒所有阻塞的任务，由它们重新检查
+static void wake_all_locked(std::vector<SimClockWaiter*>& waiters) {
+    for (SimClockWaiter* waiter : waiters) {
+        simClockWaiterNotify(waiter);
+    }
+    waiters.clear();
+}
+
+// 在 waiters 上阻塞到被唤醒或 deadline，调用时持有 lock。超时返回 false
+static bool queue_block(std::unique_lock<std::mutex>& lock, std::vector<SimClockWaiter*>& waiters, uint64_t deadline) {
+    SimClockWaiter* waiter = simClockWaiterCreate();
+    waiters.push_back(waiter);
+    lock.unlock();
+    bool notified = simClockWaiterWait(waiter, deadline);
+    lock.lock();
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i] == waiter) {
+            waiters.erase(waiters.begin() + i);
+            break;
+        }
+    }
+    simClockWaiterDestroy(waiter);
+    // 没有期限时，切换时钟模式引起的提前返回也只是重新检查
+    return notified || deadline == SIM_CLOCK_FOREVER;
+}
+
+extern "C" {
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    if (length == 0) return nullptr;
+    QueueDefinition* queue = new (std::nothrow) QueueDefinition();
+    if (queue == nullptr) return nullptr;
+    queue->storage.resize((size_t)length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t ticks, BaseType_t position) {
+    uint64_t deadline = ticks_to_deadline(ticks);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    while (queue->count == queue->length) {
+        if (ticks == 0 || (!queue_block(lock, queue->senders, deadline) && queue->count == queue->length)) {
+            return errQUEUE_FULL;
+        }
+    }
+    UBaseType_t index;
+    if (position == queueSEND_TO_FRONT) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+    } else {
+        index = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(&queue->storage[(size_t)index * queue->item_size], item, queue->item_size);
+    ++queue->count;
+    wake_all_locked(queue->receivers);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken) {
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    return xQueueGenericSend(queue, item, 0, queueSEND_TO_BACK);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks) {
+    uint64_t deadline = ticks_to_deadline(ticks);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    while (queue->count == 0) {
+        if (ticks == 0 || (!queue_block(lock, queue->receivers, deadline) && queue->count == 0)) {
+            return errQUEUE_EMPTY;
+        }
+    }
+    memcpy(buffer, &queue->storage[(size_t)queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    wake_all_locked(queue->senders);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->head = 0;
+    queue->count = 0;
+    wake_all_locked(queue->senders);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+} // extern "C"
@@ -0,0 +1,373 @@
+#ifndef _LEDC_MELODY_H_
+#define _LEDC_MELODY_H_
+
+// 编译期旋律表：把 RTTTL 格式的字符串字面量（语法与 rtttl.h 相同）在编译时换算成
+// ledcSimPlayMelody 直接播放的静态表，每一步都已算好 LEDC 分频系数、相位增量和帧数。
+//
+//     LEDC_MELODY(kNokia, 10, "Nokia:d=4,o=5,b=225:8e6,8d6,f#,g#,8c#6,8b,d,e,8b,8a,c#,e,2a");
+//     ledcAttach(pin, 1000, 10);
+//     ledcSimPlayMelody(pin, &kNokia, 1);
+//
+// 与运行时的 rtttlCompile 不同，音高使用精确的十二平均律频率（A4 = 440Hz），
+// 分频系数直接按该频率取最接近的值，而不是先取整成 ledcWriteNote 的整数 Hz。
+// 音符的起止按累计位置取整到帧，长旋律没有累积误差。
+// 格式错误、或定时器在该分辨率下无法产生的音符会让编译失败（static_assert）。
+// 受编译器 constexpr 递归深度的限制，一段旋律最多约 400 个音符。
+// 只使用 C++11 的 constexpr（单个 return 语句），所以每一步都写成层层传参的小函数。
+
+#ifndef __cplusplus
+#error "ledc_melody.h requires C++"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp32-hal-ledc-sim.h"
+
+namespace ledc_melody {
+namespace detail {
+
+// 定时器模型，与 esp32-hal-ledc-sim.cpp 相同（那里有 static_assert 检查）
+constexpr uint32_t kSampleRate = 48000;
+constexpr uint32_t kApbClockHz = 80000000u;
+constexpr uint32_t kRefClockHz = 1000000u;
+constexpr uint64_t kDividerMin = 1u << 8;       // 10.8 定点的 1.0
+constexpr uint64_t kDividerMax = (1u << 18) - 1;
+constexpr uint32_t kWholeUnits = 128;            // 时长单位：1/128 全音符
+
+// 第 4 八度的十二平均律频率
+constexpr double kOctave4[12] = {
+    261.6255653005986, 277.1826309768721, 293.6647679174076, 311.1269837220809, 329.6275569128699, 349.2282314330039,
+    369.9944227116344, 391.9954359817493, 415.3046975799451, 440.0, 466.1637615180899, 493.8833012561241,
+};
+
+// --- 字符 ---
+
+constexpr bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+constexpr bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+constexpr size_t skip_space(const char* s, size_t i) {
+    return is_space(s[i]) ? skip_space(s, i + 1) : i;
+}
+
+constexpr size_t digits_end(const char* s, size_t i) {
+    return is_digit(s[i]) ? digits_end(s, i + 1) : i;
+}
+
+// [i, end) 中的十进制数，过大的数停在 100000 以上，交给调用者按范围报错
+constexpr uint32_t number(const char* s, size_t i, size_t end, uint32_t value = 0) {
+    return i == end ? value : number(s, i + 1, end, value < 100000 ? value * 10 + (uint32_t)(s[i] - '0') : value);
+}
+
+// 从 i 开始第一个 c 或结尾 '\0' 的位置
+constexpr size_t find(const char* s, size_t i, char c) {
+    return s[i] == '\0' || s[i] == c ? i : find(s, i + 1, c);
+}
+
+// --- 名称和默认值段 ---
+
+constexpr bool valid_duration(uint32_t d) {
+    return d != 0 && d <= 64 && (d & (d - 1)) == 0;
+}
+
+constexpr bool valid_default(char key, uint32_t value) {
+    return key == 'd' ? valid_duration(value) : key == 'o' ? value <= 8 : key == 'b' ? value >= 1 && value <= 900 : false;
+}
+
+constexpr size_t name_end(const char* s) {
+    return find(s, 0, ':');
+}
+
+constexpr size_t defaults_end(const char* s) {
+    return s[name_end(s)] == ':' ? find(s, name_end(s) + 1, ':') : name_end(s);
+}
+
+constexpr bool defaults_valid(const char* s, size_t i, size_t end);
+
+constexpr bool default_next_valid(const char* s, size_t i, size_t end) {
+    return i == end || (s[i] == ',' && defaults_valid(s, i + 1, end));
+}
+
+constexpr bool default_value_valid(const char* s, size_t key, size_t value, size_t end) {
+    return digits_end(s, value) > value && valid_default(lower(s[key]), number(s, value, digits_end(s, value))) &&
+           default_next_valid(s, skip_space(s, digits_end(s, value)), end);
+}
+
+constexpr bool default_item_valid(const char* s, size_t key, size_t eq, size_t end) {
+    return s[eq] == '=' && default_value_valid(s, key, skip_space(s, eq + 1), end);
+}
+
+// 逗号分隔的 d=、o=、b=，可以省略
+constexpr bool defaults_valid(const char* s, size_t i, size_t end) {
+    return skip_space(s, i) == end || default_item_valid(s, skip_space(s, i), skip_space(s, skip_space(s, i) + 1), end);
+}
+
+constexpr uint32_t default_of(const char* s, size_t i, size_t end, char key, uint32_t fallback);
+
+constexpr uint32_t default_of_item(const char* s, size_t key_pos, size_t value, size_t end, char key, uint32_t fallback) {
+    return default_of(s, find(s, value, ',') < end ? find(s, value, ',') + 1 : end, end, key,
+                      lower(s[key_pos]) == key ? number(s, value, digits_end(s, value)) : fallback);
+}
+
+// 默认值 key 的取值，后出现的覆盖前面的
+constexpr uint32_t default_of(const char* s, size_t i, size_t end, char key, uint32_t fallback) {
+    return i >= end || skip_space(s, i) >= end
+               ? fallback
+               : default_of_item(s, skip_space(s, i), skip_space(s, skip_space(s, skip_space(s, i) + 1) + 1), end, key, fallback);
+}
+
+constexpr bool header_valid(const char* s) {
+    return s[name_end(s)] == ':' && s[defaults_end(s)] == ':' && defaults_valid(s, name_end(s) + 1, defaults_end(s));
+}
+
+constexpr size_t notes_begin(const char* s) {
+    return s[defaults_end(s)] == ':' ? defaults_end(s) + 1 : defaults_end(s);
+}
+
+constexpr uint32_t default_duration(const char* s) {
+    return default_of(s, name_end(s) + 1, defaults_end(s), 'd', 4);
+}
+
+constexpr uint32_t default_octave(const char* s) {
+    return default_of(s, name_end(s) + 1, defaults_end(s), 'o', 6);
+}
+
+constexpr uint32_t bpm(const char* s) {
+    return default_of(s, name_end(s) + 1, defaults_end(s), 'b', 63);
+}
+
+// --- 音符：[时值] 音名 [#] [.] [八度] [.] ---
+
+struct Token {
+    size_t next;     // 下一个音符的位置
+    bool ok;
+    uint32_t units;  // 时长，单位 1/128 全音符
+    int semitone;    // 0-11，-1 表示休止符
+    uint32_t octave;
+};
+
+constexpr int note_letter(char c) {
+    return c == 'c' ? 0 : c == 'd' ? 2 : c == 'e' ? 4 : c == 'f' ? 5 : c == 'g' ? 7 : c == 'a' ? 9
+         : (c == 'b' || c == 'h') ? 11 : c == 'p' ? -1 : -100;
+}
+
+constexpr uint32_t duration_units(uint32_t duration, bool dotted) {
+    return valid_duration(duration) ? kWholeUnits / duration + (dotted ? kWholeUnits / 2 / duration : 0) : 0;
+}
+
+// 分隔符；b# 折算成高八度的 c
+constexpr Token token_finish(const char* s, size_t end, uint32_t duration, bool dotted, int semitone, uint32_t octave) {
+    return Token{ s[end] == ',' ? end + 1 : end,
+                  (s[end] == ',' || s[end] == '\0') && valid_duration(duration) && semitone >= -1 && semitone <= 12 &&
+                      octave + (semitone == 12 ? 1 : 0) <= 8,
+                  duration_units(duration, dotted), semitone == 12 ? 0 : semitone, octave + (semitone == 12 ? 1 : 0) };
+}
+
+// 八度和第二个附点
+constexpr Token token_octave(const char* s, size_t i, size_t octave_end, uint32_t duration, bool dotted, int semitone,
+                             uint32_t fallback_octave) {
+    return token_finish(s, skip_space(s, octave_end + (s[octave_end] == '.' ? 1 : 0)), duration,
+                        dotted || s[octave_end] == '.', semitone,
+                        octave_end > i ? number(s, i, octave_end) : fallback_octave);
+}
+
+// 第一个附点
+constexpr Token token_dot(const char* s, size_t i, uint32_t duration, int semitone, uint32_t fallback_octave) {
+    return token_octave(s, i + (s[i] == '.' ? 1 : 0), digits_end(s, i + (s[i] == '.' ? 1 : 0)), duration, s[i] == '.',
+                        semitone, fallback_octave);
+}
+
+// 升号；休止符不能升
+constexpr Token token_sharp(const char* s, size_t i, uint32_t duration, int semitone, uint32_t fallback_octave) {
+    return token_dot(s, i + (s[i] == '#' ? 1 : 0), duration,
+                     s[i] != '#' ? semitone : semitone < 0 ? -100 : semitone + 1, fallback_octave);
+}
+
+// 时值和音名
+constexpr Token token_note(const char* s, size_t i, size_t duration_end, uint32_t fallback_duration, uint32_t fallback_octave) {
+    return token_sharp(s, duration_end + (s[duration_end] != '\0' ? 1 : 0),
+                       duration_end > i ? number(s, i, duration_end) : fallback_duration,
+                       note_letter(lower(s[duration_end])), fallback_octave);
+}
+
+constexpr Token token_at(const char* s, size_t i) {
+    return token_note(s, skip_space(s, i), digits_end(s, skip_space(s, i)), default_duration(s), default_octave(s));
+}
+
+// --- 定时器参数 ---
+
+constexpr double pitch(int semitone, uint32_t octave) {
+    return kOctave4[semitone] * (octave >= 4 ? (double)(1u << (octave - 4)) : 1.0 / (double)(1u << (4 - octave)));
+}
+
+template <uint8_t Resolution>
+constexpr uint64_t divider_for(uint32_t clock_hz, double hz) {
+    return (uint64_t)((double)clock_hz * 256.0 / (hz * (double)(1ull << Resolution)) + 0.5);
+}
+
+constexpr bool divider_valid(uint64_t divider) {
+    return divider >= kDividerMin && divider <= kDividerMax;
+}
+
+// 与真机一样优先使用 APB 时钟，分频系数超出范围时换 REF_TICK；都不行时返回 0
+template <uint8_t Resolution>
+constexpr uint32_t clock_for(double hz) {
+    return divider_valid(divider_for<Resolution>(kApbClockHz, hz)) ? kApbClockHz
+         : divider_valid(divider_for<Resolution>(kRefClockHz, hz)) ? kRefClockHz : 0;
+}
+
+// (numerator << 32) / denominator 的低 32 位（四舍五入），与模拟器的逐位长除法相同
+constexpr uint32_t ratio_bits(uint64_t remainder, uint32_t result, uint64_t denominator, int bits) {
+    return bits == 0 ? result + ((remainder << 1) >= denominator ? 1u : 0u)
+                     : ratio_bits((remainder << 1) >= denominator ? (remainder << 1) - denominator : remainder << 1,
+                                  (uint32_t)(result << 1) | ((remainder << 1) >= denominator ? 1u : 0u), denominator, bits - 1);
+}
+
+constexpr uint32_t fixed_point_ratio(uint64_t numerator, uint64_t denominator) {
+    return ratio_bits(numerator % denominator, (uint32_t)(numerator / denominator), denominator, 32);
+}
+
+template <uint8_t Resolution>
+constexpr bool token_valid(const Token& t) {
+    return t.ok && (t.semitone < 0 || clock_for<Resolution>(pitch(t.semitone, t.octave)) != 0);
+}
+
+// 位置（1/128 全音符）对应的帧号，四舍五入：全音符是 4 拍，即 4 * 60 * kSampleRate / bpm 帧
+constexpr uint64_t frame_at(uint64_t units, uint32_t bpm) {
+    return bpm == 0 ? 0 : (units * (2ull * 240 * kSampleRate / kWholeUnits) + bpm) / (2ull * bpm);
+}
+
+template <uint8_t Resolution>
+constexpr ledc_sim_melody_step_t tone_step(uint32_t clock_hz, uint64_t divider, uint32_t frames) {
+    return ledc_sim_melody_step_t{ fixed_point_ratio((uint64_t)clock_hz << 8, (divider << Resolution) * kSampleRate),
+                                   1u << (Resolution - 1),
+                                   frames,
+                                   0,
+                                   (uint32_t)divider,
+                                   clock_hz,
+                                   2 * ((uint64_t)clock_hz << 8) > (divider << Resolution) * kSampleRate };
+}
+
+template <uint8_t Resolution>
+constexpr ledc_sim_melody_step_t pitched_step(uint32_t clock_hz, double hz, uint32_t frames) {
+    return clock_hz == 0 ? ledc_sim_melody_step_t{ 0, 0, frames, 0, 0, 0, false }
+                         : tone_step<Resolution>(clock_hz, divider_for<Resolution>(clock_hz, hz), frames);
+}
+
+template <uint8_t Resolution>
+constexpr ledc_sim_melody_step_t make_step(const Token& t, uint64_t start_units, uint32_t bpm) {
+    return t.semitone < 0 || !t.ok
+               ? ledc_sim_melody_step_t{ 0, 0, (uint32_t)(frame_at(start_units + t.units, bpm) - frame_at(start_units, bpm)), 0, 0, 0, false }
+               : pitched_step<Resolution>(clock_for<Resolution>(pitch(t.semitone, t.octave)), pitch(t.semitone, t.octave),
+                                          (uint32_t)(frame_at(start_units + t.units, bpm) - frame_at(start_units, bpm)));
+}
+
+// --- 整段旋律 ---
+
+struct Cursor {
+    size_t pos;
+    uint64_t units; // 之前所有音符的总时长
+};
+
+constexpr Cursor advance(const char* s, Cursor c, uint32_t n) {
+    return n == 0 ? c : advance(s, Cursor{ token_at(s, c.pos).next, c.units + token_at(s, c.pos).units }, n - 1);
+}
+
+constexpr bool at_end(const char* s, size_t i) {
+    return s[skip_space(s, i)] == '\0';
+}
+
+// 遇到格式错误的音符就停止计数，由 valid 报错
+constexpr uint32_t count_from(const char* s, size_t i, uint32_t n) {
+    return at_end(s, i) || !token_at(s, i).ok ? n : count_from(s, token_at(s, i).next, n + 1);
+}
+
+constexpr uint32_t note_count(const char* s) {
+    return header_valid(s) ? count_from(s, notes_begin(s), 0) : 0;
+}
+
+template <uint8_t Resolution>
+constexpr bool notes_valid(const char* s, size_t i) {
+    return at_end(s, i) || (token_valid<Resolution>(token_at(s, i)) && notes_valid<Resolution>(s, token_at(s, i).next));
+}
+
+template <uint8_t Resolution>
+constexpr bool valid(const char* s) {
+    return Resolution >= 1 && Resolution <= 20 && header_valid(s) && note_count(s) > 0 && notes_valid<Resolution>(s, notes_begin(s));
+}
+
+template <uint8_t Resolution>
+constexpr ledc_sim_melody_step_t step_from(const char* s, Cursor c) {
+    return make_step<Resolution>(token_at(s, c.pos), c.units, bpm(s));
+}
+
+template <uint8_t Resolution>
+constexpr ledc_sim_melody_step_t step_at(const char* s, uint32_t index) {
+    return step_from<Resolution>(s, advance(s, Cursor{ notes_begin(s), 0 }, index));
+}
+
+constexpr uint64_t total_frames(const char* s) {
+    return frame_at(advance(s, Cursor{ notes_begin(s), 0 }, note_count(s)).units, bpm(s));
+}
+
+// 不合法的旋律换成一个休止符再生成表，编译错误只有 Compiled 里的 static_assert 一条
+template <uint8_t Resolution>
+constexpr const char* checked(const char* s) {
+    return valid<Resolution>(s) ? s : "::p";
+}
+
+template <size_t... I>
+struct IndexSequence {};
+
+template <size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndexSequence<0, I...> {
+    typedef IndexSequence<I...> type;
+};
+
+} // namespace detail
+
+// Source 提供 static constexpr const char* text()；一般通过 LEDC_MELODY 使用
+template <class Source, uint8_t Resolution,
+          class Indices = typename detail::MakeIndexSequence<detail::note_count(
+              detail::checked<Resolution>(Source::text()))>::type>
+struct Compiled;
+
+template <class Source, uint8_t Resolution, size_t... I>
+struct Compiled<Source, Resolution, detail::IndexSequence<I...>> {
+    static_assert(detail::valid<Resolution>(Source::text()),
+                  "LEDC_MELODY: malformed melody, or a note the LEDC timer cannot produce at this resolution");
+    static constexpr ledc_sim_melody_step_t steps[sizeof...(I)] = {
+        detail::step_at<Resolution>(detail::checked<Resolution>(Source::text()), I)...
+    };
+    static constexpr ledc_sim_melody_t melody = { steps, (uint32_t)sizeof...(I), Resolution,
+                                                  detail::total_frames(detail::checked<Resolution>(Source::text())) };
+};
+
+template <class Source, uint8_t Resolution, size_t... I>
+constexpr ledc_sim_melody_step_t Compiled<Source, Resolution, detail::IndexSequence<I...>>::steps[sizeof...(I)];
+
+template <class Source, uint8_t Resolution, size_t... I>
+constexpr ledc_sim_melody_t Compiled<Source, Resolution, detail::IndexSequence<I...>>::melody;
+
+} // namespace ledc_melody
+
+// 定义一个名为 name 的 ledc_sim_melody_t 常量引用，按 resolution 位分辨率编译 RTTTL 字符串 rtttl。
+// 可以放在命名空间或函数作用域
+#define LEDC_MELODY(name, resolution, rtttl)                  \
+    struct name##_LedcMelodySource {                          \
+        static constexpr const char* text() { return rtttl; } \
+    };                                                        \
+    static constexpr const ledc_sim_melody_t& name = ::ledc_melody::Compiled<name##_LedcMelodySource, resolution>::melody
+
+#endif /* _LEDC_MELODY_H_ */
@@ -4,18 +4,29 @@
 #include <thread>
 #include <chrono>
 #include <cstdlib> // For system()
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <atomic>
 #ifdef _WIN32
 #include <conio.h> // For _getch()
 #endif
 #include "esp32_tone_api.h"
 #include "esp32-hal-ledc.h"
+#include "esp32-hal-ledc-sim.h"
+#include "sim_clock.h"
+#include "rtttl.h"
+#include "midi_player.h"
+#include "ledc_melody.h"
+#include "melody_library.h"
 
 // 定义蜂鸣器连接的 GPIO 引脚。
 #define BUZZER_PIN 25
 
-// 平台无关的延时函数
+// 平台无关的延时函数，经由模拟时钟（虚拟时间模式下不占用实际时间）
 void delay_ms(int ms) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    simClockSleepMs(ms);
 }
 
 // 跨平台清屏函数
@@ -44,10 +55,13 @@ void press_any_key_to_continue() {
 
 // --- 测试函数定义 ---
 
-void test_tone_blocking() {
-    std::cout << "\n--- 测试 1: tone() API - 阻塞式播放 ---\n";
-    std::cout << "【预期表现】: 您将听到一声中等音调 (440Hz)，持续半秒。程序会在此期间暂停。\n";
+void test_tone_async() {
+    std::cout << "\n--- 测试 1: tone() API - 异步播放 ---\n";
+    std::cout << "【预期表现】: 您将听到一声中等音调 (440Hz)，持续半秒。tone() 会立即返回，声音在后台停止。\n";
     tone(BUZZER_PIN, 440, 500);
+    std::cout << "  - tone() 已返回，声音仍在播放\n";
+    delay_ms(500);
+    noTone(BUZZER_PIN); // 交还引脚，后面的测试会直接附加它
     std::cout << "【检验】: 您是否听到了持续半秒的音调？\n";
 }
 
@@ -58,8 +72,9 @@ void test_tone_melody() {
     for (int freq : melody) {
         std::cout << "  - 正在播放 " << freq << " Hz\n";
         tone(BUZZER_PIN, freq, 200);
-        delay_ms(50); // 音符间的短暂间隔
+        delay_ms(250); // tone() 立即返回，等音符播完再留出短暂间隔
     }
+    noTone(BUZZER_PIN);
     std::cout << "【检验】: 您是否听到了 'Do-Re-Mi' 旋律？\n";
 }
 
@@ -106,13 +121,524 @@ void test_ledc_write_note() {
     std::cout << "【检验】: 您是否听到了 'La' 和 'Si' 两个音符？\n";
 }
 
+void test_oscillator_benchmark() {
+    std::cout << "\n--- 测试 6: 模拟器 - 振荡器基准测试 ---\n";
+    std::cout << "【预期表现】: 打印三种振荡器渲染 3.7kHz 方波的速度与混叠电平，不发出声音。\n";
+    ledcSimRunOscillatorBenchmark(3700, 10.0);
+    std::cout << "  - 试听 BLEP 查表振荡器 (3.7kHz)\n";
+    ledcSimSetOscillator(LEDC_SIM_OSC_BLEP_TABLE);
+    tone(BUZZER_PIN, 3700, 500);
+    delay_ms(700);
+    std::cout << "  - 试听朴素振荡器 (3.7kHz)\n";
+    ledcSimSetOscillator(LEDC_SIM_OSC_NAIVE);
+    tone(BUZZER_PIN, 3700, 500);
+    delay_ms(500);
+    ledcSimSetOscillator(LEDC_SIM_OSC_POLYBLEP);
+    std::cout << "【检验】: 带限振荡器的混叠电平是否明显低于 naive？朴素振荡器是否能听到额外的杂音？\n";
+}
+
+void test_oversampled_pwm() {
+    const uint8_t channel = 0;
+    std::cout << "\n--- 测试 7: 模拟器 - 过采样 PWM 载波 ---\n";
+    std::cout << "【预期表现】: 20kHz 载波本身听不到，占空比在 25% / 75% 之间每 2ms 切换一次，\n";
+    std::cout << "              您将听到由占空比变化产生的约 250Hz 低音。先关闭、再打开过采样各播放 1 秒。\n";
+    ledcAttachChannel(BUZZER_PIN, 20000, 10, channel);
+    for (int oversampled = 0; oversampled <= 1; ++oversampled) {
+        ledcSimSetChannelOversampling(channel, oversampled != 0);
+        std::cout << (oversampled ? "  - 过采样渲染\n" : "  - 48kHz 渲染\n");
+        for (int i = 0; i < 250; ++i) {
+            ledcWriteChannel(channel, (i & 1) ? 768 : 256);
+            delay_ms(2);
+        }
+        ledcWriteChannel(channel, 0);
+        delay_ms(300);
+    }
+    ledcSimSetChannelOversampling(channel, false);
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 打开过采样后，低音是否更干净、载波折叠产生的高频杂音是否消失？\n";
+}
+
+void test_sequence() {
+    std::cout << "\n--- 测试 9: 模拟器 - 批量音符序列 ---\n";
+    std::cout << "【预期表现】: 先听到 'Do-Re-Mi-Fa-So' 一遍，然后是双音警报声循环约 1.5 秒后被取消。\n";
+    const ledc_sim_note_t melody[] = {
+        { 262, 512, 150, 50 }, { 294, 512, 150, 50 }, { 330, 512, 150, 50 }, { 349, 512, 150, 50 }, { 392, 512, 300, 0 },
+    };
+    const ledc_sim_note_t alarm[] = {
+        { 2000, 512, 100, 0 }, { 1500, 512, 100, 50 },
+    };
+    ledcAttach(BUZZER_PIN, 1000, 10);
+    std::cout << "  - 一次提交整段旋律\n";
+    uint32_t serial = ledcSimPlaySequence(BUZZER_PIN, melody, sizeof(melody) / sizeof(melody[0]), 1);
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    std::cout << "  - 旋律播放完成\n";
+    delay_ms(200);
+    std::cout << "  - 循环播放警报，1.5 秒后取消\n";
+    serial = ledcSimPlaySequence(BUZZER_PIN, alarm, sizeof(alarm) / sizeof(alarm[0]), 0);
+    delay_ms(1500);
+    ledcSimStopSequence(BUZZER_PIN);
+    // 取消命令与其他命令一样在输出延迟之后生效
+    bool stopped = ledcSimWaitToneGate(BUZZER_PIN, serial, simClockNowNs() + 100000000ull);
+    std::cout << (stopped ? "  - 警报已取消\n" : "  - 错误: 警报仍在播放\n");
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 旋律的节奏是否均匀？警报是否在取消时立即停止？\n";
+}
+
+void test_sweep() {
+    std::cout << "\n--- 测试 10: 模拟器 - 频率扫描 ---\n";
+    std::cout << "【预期表现】: 先听到 200Hz 到 2000Hz 的线性上滑，然后是三次平滑起伏的警报声。\n";
+    ledcAttach(BUZZER_PIN, 1000, 10);
+    std::cout << "  - 线性扫描 200Hz -> 2000Hz (1 秒)\n";
+    uint32_t serial = ledcSimSweep(BUZZER_PIN, 200, 2000, 1000, LEDC_SIM_SWEEP_LINEAR);
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    delay_ms(200);
+    std::cout << "  - 指数扫描警报声，一次提交、无缝衔接\n";
+    for (int i = 0; i < 3; ++i) {
+        ledcSimSweep(BUZZER_PIN, 600, 1800, 400, LEDC_SIM_SWEEP_EXPONENTIAL);
+        serial = ledcSimSweep(BUZZER_PIN, 1800, 600, 400, LEDC_SIM_SWEEP_EXPONENTIAL);
+    }
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 频率变化是否平滑、没有台阶感？警报声的起伏之间是否没有停顿？\n";
+}
+
+void test_modulation() {
+    const uint8_t channel = 0;
+    std::cout << "\n--- 测试 11: 模拟器 - LFO 调制 ---\n";
+    std::cout << "【预期表现】: 1kHz 音调依次加上 6Hz 轻微颤音、8Hz 双音警报和 0.5Hz 三角波警笛，各 1.5 秒。\n";
+    ledcAttachChannel(BUZZER_PIN, 1000, 10, channel);
+    ledcWriteTone(BUZZER_PIN, 1000);
+    std::cout << "  - 正弦颤音 6Hz, ±30 音分\n";
+    ledcSimSetModulation(channel, 6.0f, 30.0f, LEDC_SIM_LFO_SINE);
+    delay_ms(1500);
+    std::cout << "  - 方波双音警报 8Hz, ±350 音分\n";
+    ledcSimSetModulation(channel, 8.0f, 350.0f, LEDC_SIM_LFO_SQUARE);
+    delay_ms(1500);
+    std::cout << "  - 三角波警笛 0.5Hz, ±700 音分\n";
+    ledcSimSetModulation(channel, 0.5f, 700.0f, LEDC_SIM_LFO_TRIANGLE);
+    delay_ms(1500);
+    ledcSimSetModulation(channel, 0.0f, 0.0f, LEDC_SIM_LFO_SINE);
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 三种效果是否都平滑连续，没有台阶或咔哒声？\n";
+}
+
+// 渐变完成中断：在模拟的中断线程里接着发起反方向的渐变，形成"呼吸"效果
+struct FadeBreath {
+    std::atomic<int> finished;
+    std::thread::id isr_thread;
+};
+
+static void on_fade_done(void* arg) {
+    FadeBreath* breath = (FadeBreath*)arg;
+    breath->isr_thread = std::this_thread::get_id();
+    int n = ++breath->finished;
+    if (n < 6) {
+        bool up = n % 2 == 0;
+        ledcFadeWithInterruptArg(BUZZER_PIN, up ? 0 : 512, up ? 512 : 0, 1000, on_fade_done, arg);
+    }
+}
+
+void test_fade() {
+    std::cout << "\n--- 测试 12: ledcFade 占空比渐变 ---\n";
+    std::cout << "【预期表现】: 1kHz 音调由弱渐强、再由强渐弱，每段 1 秒，共呼吸 3 次。\n";
+    static FadeBreath breath;
+    breath.finished = 0;
+    breath.isr_thread = std::thread::id();
+    ledcAttach(BUZZER_PIN, 1000, 10);
+    std::cout << "  - 一次 ledcFadeWithInterruptArg 调用开始第一段渐变，之后的渐变由完成中断发起\n";
+    ledcFadeWithInterruptArg(BUZZER_PIN, 0, 512, 1000, on_fade_done, &breath);
+    delay_ms(6500); // 实时模式下每段渐变在输出延迟之后才结束
+    bool ok = breath.finished == 6 && breath.isr_thread != std::this_thread::get_id();
+    std::cout << (ok ? "  - 6 次渐变完成中断都已在中断线程中执行\n" : "  - 错误: 渐变完成中断次数不对\n");
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 音量变化是否平滑、没有台阶或咔哒声？\n";
+}
+
+void test_rtttl() {
+    std::cout << "\n--- 测试 13: RTTTL 铃声 ---\n";
+    std::cout << "【预期表现】: 先听到上行音阶和 Nokia 铃声（边解析边播放），再听到同一段铃声的预编译版本。\n";
+    const char* ringtones[] = {
+        "Scale:d=8,o=5,b=160:c,d,e,f,g,a,b,4c6,p,4c6,b,a,g,f,e,d,2c",
+        "Nokia:d=4,o=5,b=225:8e6,8d6,f#,g#,8c#6,8b,d,e,8b,8a,c#,e,2a",
+        "Dotted:d=16,o=6,b=100:8c.,d,8e.,f,8g.,a,4b.,c7,2p,4c.,8d5.",
+        "Broken:d=4,o=5,b=120:c,d,x,e",
+    };
+    const int count = sizeof(ringtones) / sizeof(ringtones[0]);
+
+    std::cout << "  - 批量校验 / 预编译\n";
+    ledc_sim_note_t notes[64];
+    const char* error = NULL;
+    size_t offset = 0;
+    for (int i = 0; i < count; ++i) {
+        rtttl_parser_t parser;
+        rtttlParserInit(&parser, ringtones[i]);
+        int32_t n = rtttlCompile(ringtones[i], notes, 64, 512, &error, &offset);
+        if (n < 0) {
+            printf("    %-8.*s 错误: %s (位置 %u)\n", (int)parser.name_length, parser.name, error, (unsigned)offset);
+        } else {
+            uint32_t total_ms = 0;
+            for (int32_t j = 0; j < n; ++j) total_ms += notes[j].duration_ms;
+            printf("    %-8.*s %d 个音符, %u ms\n", (int)parser.name_length, parser.name, n, total_ms);
+        }
+    }
+    const int rounds = 20000;
+    auto t0 = std::chrono::steady_clock::now();
+    int32_t total = 0;
+    for (int i = 0; i < rounds; ++i) {
+        total += rtttlCompile(ringtones[i % (count - 1)], notes, 64, 512, NULL, NULL);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("    %d 个铃声 (%d 个音符) 用时 %.1f ms，约 %.0f 个/秒\n", rounds, total, seconds * 1000.0, rounds / seconds);
+
+    ledcAttach(BUZZER_PIN, 1000, 10);
+    for (int i = 0; i < 2; ++i) {
+        rtttl_parser_t parser;
+        rtttlParserInit(&parser, ringtones[i]);
+        printf("  - 播放 %.*s (d=%u, o=%u, b=%u)\n", (int)parser.name_length, parser.name, parser.default_duration,
+               parser.default_octave, parser.bpm);
+        uint32_t serial = rtttlPlay(BUZZER_PIN, ringtones[i]);
+        ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+        delay_ms(300);
+    }
+    std::cout << "  - 预编译的 Nokia 铃声交给 ledcSimPlaySequence\n";
+    int32_t n = rtttlCompile(ringtones[1], notes, 64, 512, NULL, NULL);
+    uint32_t serial = ledcSimPlaySequence(BUZZER_PIN, notes, (uint32_t)n, 1);
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 音高与 ledcWriteNote 是否一致？两次 Nokia 铃声的节奏是否完全相同？\n";
+}
+
+// 生成测试 14 使用的 MIDI 文件（格式 1，每四分音符 480 tick，4 小节）：
+// 速度轨在第 3 小节从 120 BPM 变为 90 BPM；旋律；和弦（第 3 小节用延音踏板，第 4 小节是 13 个音的大和弦，
+// 与旋律和踏板维持的音加起来超过 16 个）；以及默认被跳过的打击乐
+struct MidiTrackBuilder {
+    std::vector<uint8_t> data;
+    uint32_t tick = 0;
+    void event(uint32_t at, std::initializer_list<uint8_t> bytes) {
+        uint32_t delta = at - tick;
+        tick = at;
+        uint8_t var[4];
+        int n = 0;
+        do {
+            var[n++] = delta & 0x7F;
+            delta >>= 7;
+        } while (delta);
+        while (n > 1) data.push_back(var[--n] | 0x80);
+        data.push_back(var[0]);
+        data.insert(data.end(), bytes);
+    }
+};
+
+static bool write_test_midi(const char* path) {
+    const uint32_t bar = 4 * 480;
+    MidiTrackBuilder tracks[4];
+    tracks[0].event(0, { 0xFF, 0x51, 3, 0x07, 0xA1, 0x20 });       // 500000 us
+    tracks[0].event(2 * bar, { 0xFF, 0x51, 3, 0x0A, 0x2C, 0x2B }); // 666667 us
+    const uint8_t scale[] = { 72, 74, 76, 77, 79, 81, 83, 84 };
+    for (uint32_t i = 0; i < 32; ++i) {
+        uint8_t note = scale[(i / 8) % 2 ? 7 - i % 8 : i % 8];
+        tracks[1].event(i * 240, { 0x90, note, 90 });
+        tracks[1].event(i * 240 + 200, { 0x80, note, 0 });
+    }
+    const uint8_t chords[2][3] = { { 60, 64, 67 }, { 65, 69, 72 } };
+    for (uint32_t b = 0; b < 2; ++b) {
+        for (uint8_t note : chords[b]) tracks[2].event(b * bar, { 0x91, note, 70 });
+        for (uint8_t note : chords[b]) tracks[2].event(b * bar + bar - 60, { 0x91, note, 0 });
+    }
+    tracks[2].event(2 * bar, { 0xB1, 64, 127 });
+    const uint8_t arpeggio[] = { 55, 59, 62, 65 };
+    for (uint32_t i = 0; i < 4; ++i) {
+        tracks[2].event(2 * bar + i * 480, { 0x91, arpeggio[i], 70 });
+        tracks[2].event(2 * bar + i * 480 + 240, { 0x81, arpeggio[i], 0 });
+    }
+    const uint8_t cluster[] = { 36, 40, 43, 48, 52, 55, 60, 64, 67, 72, 76, 79, 84 };
+    for (uint8_t note : cluster) tracks[2].event(3 * bar, { 0x91, note, 70 });
+    tracks[2].event(3 * bar + 960, { 0xB1, 64, 0 });
+    for (uint8_t note : cluster) tracks[2].event(4 * bar, { 0x81, note, 0 });
+    for (uint32_t beat = 0; beat < 16; ++beat) {
+        tracks[3].event(beat * 480, { 0x99, 36, 100 });
+        tracks[3].event(beat * 480 + 120, { 0x89, 36, 0 });
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    const uint8_t header[] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 4, 480 >> 8, 480 & 0xFF };
+    fwrite(header, 1, sizeof(header), file);
+    for (MidiTrackBuilder& track : tracks) {
+        track.event(4 * bar, { 0xFF, 0x2F, 0 });
+        uint32_t length = (uint32_t)track.data.size();
+        const uint8_t chunk[] = { 'M', 'T', 'r', 'k', (uint8_t)(length >> 24), (uint8_t)(length >> 16), (uint8_t)(length >> 8),
+                                  (uint8_t)length };
+        fwrite(chunk, 1, sizeof(chunk), file);
+        fwrite(track.data.data(), 1, length, file);
+    }
+    return fclose(file) == 0;
+}
+
+void test_midi() {
+    std::cout << "\n--- 测试 14: 模拟器 - MIDI 文件复音播放 ---\n";
+    std::cout << "【预期表现】: 旋律加和弦共 4 小节，第 3 小节起变慢（120 -> 90 BPM），最后是一个很厚的大和弦，约 9.3 秒。\n";
+    const char* path = "buzzer_sim_test.mid";
+    if (!write_test_midi(path)) {
+        std::cout << "  - 错误: 无法写入 " << path << "\n";
+        return;
+    }
+    uint8_t pins[MIDI_MAX_VOICES];
+    for (uint8_t i = 0; i < MIDI_MAX_VOICES; ++i) pins[i] = (uint8_t)(BUZZER_PIN + i);
+    MidiPlayer* player = midiPlayerOpen(path);
+    if (player == NULL || !midiPlayerStart(player, pins, MIDI_MAX_VOICES, false)) {
+        std::cout << "  - 错误: 无法播放 MIDI 文件\n";
+        midiPlayerClose(player);
+        remove(path);
+        return;
+    }
+    std::cout << "  - 16 个声部，每个声部一个 LEDC 通道\n";
+    midiPlayerWait(player, SIM_CLOCK_FOREVER);
+    midi_player_stats_t stats;
+    midiPlayerGetStats(player, &stats);
+    printf("  - 播放结束: %u 个音符，最多 %u 个同时发声，抢占 %u 次，跳过 %u 个打击乐音符，时长 %u ms\n", stats.notes,
+           stats.max_active, stats.stolen, stats.skipped, stats.position_ms);
+    midiPlayerClose(player);
+    remove(path);
+    std::cout << "【检验】: 和弦与旋律是否同时发声、节奏稳定？变速是否平滑？大和弦进入时是否没有卡顿？\n";
+}
+
+// 测试 15 使用的编译期旋律表：与测试 13 的 Nokia 铃声相同，但在编译时就已换算成定时器参数
+LEDC_MELODY(k_nokia_melody, 10, "Nokia:d=4,o=5,b=225:8e6,8d6,f#,g#,8c#6,8b,d,e,8b,8a,c#,e,2a");
+
+void test_compiled_melody() {
+    std::cout << "\n--- 测试 15: 模拟器 - 编译期旋律表 ---\n";
+    std::cout << "【预期表现】: Nokia 铃声播放两遍，与测试 13 的节奏相同，音高是精确的十二平均律频率。\n";
+    LEDC_MELODY(scale, 10, "Scale:d=8,o=5,b=160:c,d,e,f,g,a,b,4c6");
+    printf("  - Nokia: %u 个音符, %llu 帧；音阶: %u 个音符, %llu 帧\n", k_nokia_melody.count,
+           (unsigned long long)k_nokia_melody.total_frames, scale.count, (unsigned long long)scale.total_frames);
+    for (uint32_t i = 0; i < 3; ++i) {
+        const ledc_sim_melody_step_t& step = k_nokia_melody.steps[i];
+        printf("    第 %u 步: 时钟 %u Hz, 分频 %u.%03u, 相位增量 %u, %u 帧\n", i, step.clock_hz, step.divider >> 8,
+               (step.divider & 0xFF) * 1000 / 256, step.phase_increment, step.note_frames);
+    }
+
+    ledcAttach(BUZZER_PIN, 1000, 10);
+    std::cout << "  - 播放音阶\n";
+    uint32_t serial = ledcSimPlayMelody(BUZZER_PIN, &scale, 1);
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    delay_ms(300);
+    std::cout << "  - 播放 Nokia 铃声两遍\n";
+    serial = ledcSimPlayMelody(BUZZER_PIN, &k_nokia_melody, 2);
+    ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 两遍铃声之间是否没有停顿？节奏是否与测试 13 一致？\n";
+}
+
+void test_melody_library() {
+    std::cout << "\n--- 测试 16: 模拟器 - 二进制旋律库 ---\n";
+    std::cout << "【预期表现】: 生成一个含 20000 个提示音的库文件，映射后按名称和 ID 查找，再播放其中两个。\n";
+    const char* path = "buzzer_sim_test.bzml";
+    const uint32_t count = 20000;
+    const uint32_t notes_per_melody = 8;
+    // 每个“型号”的提示音是从 C 大调音阶里取的 8 个音，外加测试 13 的 Nokia 铃声
+    const uint32_t scale[] = { 523, 587, 659, 698, 784, 880, 988, 1047 };
+    std::vector<ledc_sim_note_t> notes(count * notes_per_melody);
+    std::vector<std::string> names(count);
+    std::vector<melody_library_source_t> sources(count + 1);
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t j = 0; j < notes_per_melody; ++j) {
+            ledc_sim_note_t& note = notes[i * notes_per_melody + j];
+            note.frequency = (i + j) % 5 == 4 ? 0 : scale[(i * 7 + j * 3) % 8];
+            note.duty = note.frequency ? 512 : 0;
+            note.duration_ms = 60 + 20 * ((i + j) % 3);
+            note.gap_ms = j % 2 ? 20 : 0;
+        }
+        names[i] = "SKU-" + std::to_string(100000 + i) + "-beep";
+        sources[i] = { 1000 + i * 3, names[i].c_str(), &notes[i * notes_per_melody], notes_per_melody };
+    }
+    ledc_sim_note_t nokia[64];
+    int32_t nokia_count = rtttlCompile("Nokia:d=4,o=5,b=225:8e6,8d6,f#,g#,8c#6,8b,d,e,8b,8a,c#,e,2a", nokia, 64, 512, NULL, NULL);
+    sources[count] = { 7, "Nokia", nokia, (uint32_t)nokia_count };
+    if (!melodyLibraryWrite(path, sources.data(), count + 1, 10)) {
+        std::cout << "  - 错误: 无法写入 " << path << "\n";
+        return;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    MelodyLibrary* library = melodyLibraryOpen(path);
+    double open_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (library == NULL) {
+        std::cout << "  - 错误: 无法打开 " << path << "\n";
+        remove(path);
+        return;
+    }
+    FILE* file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    long bytes = ftell(file);
+    fclose(file);
+    printf("  - %u 个旋律，文件 %ld 字节（音符数组需要 %u 字节），打开用时 %.1f us\n", melodyLibraryCount(library), bytes,
+           (unsigned)((count * notes_per_melody + nokia_count) * sizeof(ledc_sim_note_t)), open_us);
+
+    // 查找并逐个与原始音符比较
+    uint32_t mismatches = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t by_name = melodyLibraryFindName(library, names[i].c_str());
+        if (by_name < 0 || melodyLibraryFindId(library, sources[i].id) != by_name) ++mismatches;
+    }
+    double lookup_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / (2.0 * count);
+    for (uint32_t i = 0; i <= count; ++i) {
+        ledc_sim_note_t decoded[64];
+        int32_t n = melodyLibraryDecode(library, (uint32_t)melodyLibraryFindId(library, sources[i].id), decoded, 64);
+        if (n != (int32_t)sources[i].count || memcmp(decoded, sources[i].notes, n * sizeof(ledc_sim_note_t)) != 0) ++mismatches;
+    }
+    bool missing_ok = melodyLibraryFindName(library, "SKU-none") < 0 && melodyLibraryFindId(library, 1001) < 0;
+    printf("  - 每次查找约 %.0f ns，解码与原始数据不一致 %u 个，查找不存在的条目: %s\n", lookup_ns, mismatches,
+           missing_ok ? "正确返回 -1" : "错误");
+
+    ledcAttach(BUZZER_PIN, 1000, melodyLibraryResolution(library));
+    const char* play[] = { "SKU-100042-beep", "Nokia" };
+    for (const char* name : play) {
+        melody_library_info_t info;
+        int32_t index = melodyLibraryFindName(library, name);
+        melodyLibraryGetInfo(library, (uint32_t)index, &info);
+        printf("  - 播放 %.*s (ID %u, %u 个音符, %u ms)\n", (int)info.name_length, info.name, info.id, info.note_count,
+               info.duration_ms);
+        uint32_t serial = melodyLibraryPlay(library, (uint32_t)index, BUZZER_PIN, 1);
+        ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+        delay_ms(300);
+    }
+    ledcDetach(BUZZER_PIN);
+    melodyLibraryClose(library);
+    remove(path);
+    std::cout << "【检验】: 打开和查找是否都很快？Nokia 铃声是否与测试 13 相同？\n";
+}
+
+// 合成一段类似语音提示的 PCM：基频从 140Hz 滑到 110Hz 的脉冲串经过两个共振峰，音量有起伏
+static std::vector<float> synthesize_prompt(uint32_t sample_rate, double seconds) {
+    const double kPi = 3.14159265358979323846;
+    std::vector<float> pcm((size_t)(sample_rate * seconds));
+    const double formants[2][2] = { { 700.0, 0.5 }, { 1200.0, 0.35 } }; // 频率、相对幅度
+    double pitch_phase = 0.0;
+    double state[2][2] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+    for (size_t i = 0; i < pcm.size(); ++i) {
+        double t = (double)i / sample_rate;
+        double f0 = 140.0 - 30.0 * t / seconds;
+        pitch_phase += f0 / sample_rate;
+        double excitation = 0.0;
+        if (pitch_phase >= 1.0) {
+            pitch_phase -= 1.0;
+            excitation = 1.0;
+        }
+        double out = 0.0;
+        for (int k = 0; k < 2; ++k) {
+            // 二阶谐振器
+            double r = 0.97, w = 2.0 * kPi * formants[k][0] / sample_rate;
+            double y = excitation + 2.0 * r * std::cos(w) * state[k][0] - r * r * state[k][1];
+            state[k][1] = state[k][0];
+            state[k][0] = y;
+            out += formants[k][1] * y * (1.0 - r);
+        }
+        double envelope = std::sin(kPi * t / seconds) * (0.6 + 0.4 * std::sin(2.0 * kPi * 3.0 * t));
+        pcm[i] = (float)(out * envelope * 4.0);
+    }
+    return pcm;
+}
+
+void test_pwm_dac() {
+    std::cout << "\n--- 测试 17: 模拟器 - PWM-DAC 语音提示 ---\n";
+    std::cout << "【预期表现】: 同一段合成的语音提示以 8kHz 和 16kHz 采样率各播放一遍（8 位 PWM，载波 312.5kHz）。\n";
+    ledcAttach(BUZZER_PIN, 312500, 8);
+    const uint32_t rates[] = { 8000, 16000 };
+    for (uint32_t rate : rates) {
+        std::vector<float> pcm = synthesize_prompt(rate, 1.2);
+        // 与真机的定时器中断一样按 8 位占空比输出，128 为零电平
+        std::vector<uint32_t> duties(pcm.size());
+        for (size_t i = 0; i < pcm.size(); ++i) {
+            duties[i] = (uint32_t)std::max(0, std::min(255, (int)std::lround(128.0f + 127.0f * pcm[i])));
+        }
+        // 每 20ms 一块，像双缓冲的 DMA 一样提前一块提交
+        const uint32_t block = rate / 50;
+        uint32_t blocks = 0, serial = 0, previous = 0;
+        for (size_t pos = 0; pos < duties.size(); pos += block) {
+            uint32_t count = (uint32_t)std::min<size_t>(block, duties.size() - pos);
+            uint32_t next = ledcSimWriteSamples(BUZZER_PIN, &duties[pos], count, rate);
+            if (next == 0) break;
+            if (previous) ledcSimWaitToneGate(BUZZER_PIN, previous, SIM_CLOCK_FOREVER);
+            previous = serial = next;
+            ++blocks;
+        }
+        printf("  - %u Hz: %u 个采样，%u 块\n", rate, (unsigned)duties.size(), blocks);
+        ledcSimWaitToneGate(BUZZER_PIN, serial, SIM_CLOCK_FOREVER);
+        delay_ms(300);
+    }
+    ledcDetach(BUZZER_PIN);
+    std::cout << "【检验】: 两遍是否都连续、没有咔嗒声？16kHz 的一遍是否比 8kHz 更明亮？\n";
+}
+
+// 对渲染输出做 FNV-1a 哈希，用于比较两次运行的音频是否逐位相同
+struct AudioDigest {
+    uint64_t hash;
+    uint64_t frames;
+};
+
+static void digest_audio(const float* samples, uint32_t frames, void* user) {
+    AudioDigest* digest = (AudioDigest*)user;
+    const unsigned char* bytes = (const unsigned char*)samples;
+    for (size_t i = 0; i < frames * sizeof(float); ++i) {
+        digest->hash = (digest->hash ^ bytes[i]) * 1099511628211ull;
+    }
+    digest->frames += frames;
+}
+
+// 回归场景：一分钟的旋律，混合使用 tone() 与底层 ledc 调用
+static void regression_scenario() {
+    const int melody[] = {262, 294, 330, 349, 392, 440, 494, 523};
+    for (int bar = 0; bar < 20; ++bar) {
+        for (int freq : melody) {
+            tone(BUZZER_PIN, freq + bar * 10, 200);
+            delay_ms(250);
+        }
+        // 与真机一样，直接使用 ledc 之前先用 noTone 交还引脚；
+        // 零延时让 FreeRTOS 版本的 tone 任务先处理完请求（虚拟时间下不推进时钟）
+        noTone(BUZZER_PIN);
+        delay_ms(0);
+        ledcAttach(BUZZER_PIN, 500, 10);
+        ledcWriteNote(BUZZER_PIN, NOTE_A, 4 + bar % 3);
+        delay_ms(500);
+        ledcWrite(BUZZER_PIN, 128);
+        delay_ms(500);
+        ledcDetach(BUZZER_PIN);
+    }
+}
+
+void test_virtual_clock() {
+    std::cout << "\n--- 测试 8: 模拟器 - 虚拟时间回归测试 ---\n";
+    std::cout << "【预期表现】: 在虚拟时间下把一分钟的旋律运行两次，不发出声音，几乎立即完成。\n";
+    AudioDigest digests[2];
+    for (int run = 0; run < 2; ++run) {
+        digests[run].hash = 14695981039346656037ull;
+        digests[run].frames = 0;
+        simClockSetMode(SIM_CLOCK_VIRTUAL); // 每次切换都从虚拟时间 0 开始
+        ledcSimSetOutputCallback(digest_audio, &digests[run]);
+        auto t0 = std::chrono::steady_clock::now();
+        regression_scenario();
+        delay_ms(10); // 让最后的尾音渲染完
+        double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        double sim_ms = simClockNowNs() / 1e6;
+        ledcSimSetOutputCallback(NULL, NULL);
+        printf("  - 第 %d 次: 模拟 %.0f ms，实际 %.1f ms (%.0fx)，%llu 帧，哈希 %016llx\n", run + 1, sim_ms, wall_ms,
+               sim_ms / wall_ms, (unsigned long long)digests[run].frames, (unsigned long long)digests[run].hash);
+    }
+    simClockSetMode(SIM_CLOCK_REAL);
+    std::cout << (digests[0].hash == digests[1].hash && digests[0].frames == digests[1].frames
+                  ? "  - 两次输出逐位相同\n" : "  - 错误: 两次输出不一致！\n");
+    std::cout << "【检验】: 模拟时长是否约为 60 秒、两次运行的哈希是否相同？\n";
+}
+
 
 void display_menu() {
     std::cout << "========================================\n";
     std::cout << "  ESP32 蜂鸣器模拟器 - 交互式测试台\n";
     std::cout << "========================================\n";
     std::cout << "  高层 tone() API 测试:\n";
-    std::cout << "    1. 测试 tone() 的阻塞式播放\n";
+    std::cout << "    1. 测试 tone() 的异步播放\n";
     std::cout << "    2. 测试 tone() 播放旋律\n";
     std::cout << "----------------------------------------\n";
     std::cout << "  底层 ledc API 测试:\n";
@@ -120,16 +646,116 @@ void display_menu() {
     std::cout << "    4. 测试 ledcChangeFrequency\n";
     std::cout << "    5. 测试 ledcWriteNote\n";
     std::cout << "----------------------------------------\n";
+    std::cout << "  模拟器测试:\n";
+    std::cout << "    6. 振荡器基准测试 (naive / PolyBLEP / BLEP 查表)\n";
+    std::cout << "    7. 过采样 PWM 载波 (20kHz 占空比调制)\n";
+    std::cout << "    8. 虚拟时间回归测试\n";
+    std::cout << "    9. 批量音符序列 (旋律 / 循环警报)\n";
+    std::cout << "   10. 频率扫描 (线性 / 指数警报声)\n";
+    std::cout << "   11. LFO 调制 (颤音 / 双音警报 / 警笛)\n";
+    std::cout << "   12. ledcFade 占空比渐变 (渐变完成中断)\n";
+    std::cout << "   13. RTTTL 铃声 (流式播放 / 批量预编译)\n";
+    std::cout << "   14. MIDI 文件复音播放 (16 声部 / 声部抢占)\n";
+    std::cout << "   15. 编译期旋律表 (LEDC_MELODY)\n";
+    std::cout << "   16. 二进制旋律库 (内存映射 / 按名称和 ID 查找)\n";
+    std::cout << "   17. PWM-DAC 语音提示 (8 / 16kHz 采样流)\n";
+    std::cout << "----------------------------------------\n";
     std::cout << "    0. 退出程序\n";
     std::cout << "========================================\n";
     std::cout << "请输入您的选择: ";
 }
 
+// 可以离线渲染成 WAV 的测试场景（不含基准测试和自行切换时钟的虚拟时间测试）
+struct WavScenario {
+    const char* name;
+    void (*run)();
+};
+
+static const WavScenario k_wav_scenarios[] = {
+    { "test1_tone_async", test_tone_async },
+    { "test2_tone_melody", test_tone_melody },
+    { "test3_ledc_attach_write_detach", test_ledc_attach_write_detach },
+    { "test4_ledc_change_freq", test_ledc_change_freq },
+    { "test5_ledc_write_note", test_ledc_write_note },
+    { "test7_oversampled_pwm", test_oversampled_pwm },
+    { "test9_sequence", test_sequence },
+    { "test10_sweep", test_sweep },
+    { "test11_modulation", test_modulation },
+    { "test12_fade", test_fade },
+    { "test13_rtttl", test_rtttl },
+    { "test14_midi", test_midi },
+    { "test15_compiled_melody", test_compiled_melody },
+    { "test16_melody_library", test_melody_library },
+    { "test17_pwm_dac", test_pwm_dac },
+};
+
+static void run_wav_scenario(void* user) {
+    ((const WavScenario*)user)->run();
+}
+
+// --render-wav <目录>：在虚拟时间下依次渲染所有测试场景，每个场景写一个 WAV 文件，不需要声卡
+static int render_all_wav(const std::string& dir) {
+    int failures = 0;
+    for (const WavScenario& scenario : k_wav_scenarios) {
+        std::string path = dir + "/" + scenario.name + ".wav";
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok = ledcSimRenderToWav(path.c_str(), run_wav_scenario, (void*)&scenario);
+        double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if (ok) {
+            std::cout << "[WAV] " << path << " (" << wall_ms << " ms)\n";
+        } else {
+            std::cout << "[WAV] 错误: 无法写入 " << path << "\n";
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// --headless-check：强制使用 null 后端实时播放一个 440Hz 音调，从捕获缓冲区读回并检查频率与电平，
+// 用于在没有声卡的 CI 上确认模拟器输出正常。通过时返回 0
+static int headless_check() {
+    const uint32_t capacity = 2 * 48000;
+    ledcSimSetBackend(LEDC_SIM_BACKEND_NULL);
+    if (!ledcSimStartCapture(capacity)) return 1;
+    tone(BUZZER_PIN, 440, 500);
+    delay_ms(600);
+
+    std::vector<float> samples(capacity);
+    uint32_t frames = ledcSimReadCapture(samples.data(), capacity);
+    ledcSimStopCapture();
+    // 统计有声部分的电平，并用过零次数估计频率
+    double energy = 0.0;
+    uint32_t sounding = 0, crossings = 0, first = 0, last = 0;
+    for (uint32_t i = 0; i < frames; ++i) {
+        if (std::fabs(samples[i]) < 0.02f) continue;
+        energy += samples[i] * samples[i];
+        if (sounding++ == 0) first = i;
+        last = i;
+    }
+    for (uint32_t i = first + 1; i <= last; ++i) {
+        if ((samples[i - 1] < 0.0f) != (samples[i] < 0.0f)) ++crossings;
+    }
+    double rms = sounding ? std::sqrt(energy / sounding) : 0.0;
+    double seconds = (double)(last - first) / 48000.0;
+    double freq = seconds > 0.0 ? crossings / 2.0 / seconds : 0.0;
+    bool ok = frames > 0 && rms > 0.05 && std::fabs(freq - 440.0) < 5.0 && std::fabs(seconds - 0.5) < 0.05;
+    printf("[HEADLESS] %u frames captured, tone %.3f s, %.1f Hz, rms %.3f, dropped %llu: %s\n", frames, seconds, freq, rms,
+           (unsigned long long)ledcSimGetCaptureDropped(), ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
+
 // 应用程序的主入口点。
-int main() {
+int main(int argc, char* argv[]) {
     // 解决 Windows 命令行输出中文乱码的问题
     system("chcp 65001 > nul");
 
+    if (argc == 3 && std::string(argv[1]) == "--render-wav") {
+        return render_all_wav(argv[2]);
+    }
+    if (argc == 2 && std::string(argv[1]) == "--headless-check") {
+        return headless_check();
+    }
+
     int choice = -1;
     while (choice != 0) {
         clear_screen();
@@ -147,11 +773,23 @@ int main() {
         }
 
         switch (choice) {
-            case 1: test_tone_blocking(); break;
+            case 1: test_tone_async(); break;
             case 2: test_tone_melody(); break;
             case 3: test_ledc_attach_write_detach(); break;
             case 4: test_ledc_change_freq(); break;
             case 5: test_ledc_write_note(); break;
+            case 6: test_oscillator_benchmark(); break;
+            case 7: test_oversampled_pwm(); break;
+            case 8: test_virtual_clock(); break;
+            case 9: test_sequence(); break;
+            case 10: test_sweep(); break;
+            case 11: test_modulation(); break;
+            case 12: test_fade(); break;
+            case 13: test_rtttl(); break;
+            case 14: test_midi(); break;
+            case 15: test_compiled_melody(); break;
+            case 16: test_melody_library(); break;
+            case 17: test_pwm_dac(); break;
             case 0: break; // 退出循环
             default:
                 std::cout << "\n错误: 无效选项，请重新选择。\n";
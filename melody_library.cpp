@@ -0,0 +1,404 @@
+#include "melody_library.h"
+#include "esp32-hal-ledc.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LIBRARY_HEADER_SIZE 48
+#define LIBRARY_ENTRY_SIZE  24
+
+static const char k_magic[4] = { 'B', 'Z', 'M', 'L' };
+
+struct MelodyLibrary {
+    const uint8_t* data; // 映射的整个文件
+    uint32_t size;
+    uint32_t entry_count;
+    uint32_t frequency_count;
+    uint32_t frequency_offset;
+    uint32_t entry_offset;
+    uint32_t slot_mask;
+    uint32_t id_slot_offset;
+    uint32_t name_slot_offset;
+    uint8_t resolution;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// --- 小端序读写 ---
+
+static uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put_u32(std::vector<uint8_t>& out, size_t at, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[at + i] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_u16(std::vector<uint8_t>& out, size_t at, uint16_t value) {
+    out[at] = (uint8_t)value;
+    out[at + 1] = (uint8_t)(value >> 8);
+}
+
+static void append_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// 从 [p, end) 读一个变长整数，越界或超过 32 位时返回 false
+static bool read_varint(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end) return false;
+        uint8_t byte = *p++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return shift < 28 || byte < 0x10;
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// --- 散列 ---
+
+static uint32_t hash_name(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    return hash;
+}
+
+static uint32_t hash_id(uint32_t id) {
+    uint32_t hash = id * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+// 第 index 个旋律表项在文件中的位置
+static const uint8_t* entry_at(const MelodyLibrary* library, uint32_t index) {
+    return library->data + library->entry_offset + (size_t)index * LIBRARY_ENTRY_SIZE;
+}
+
+// 偏移和长度都落在文件内
+static bool in_file(const MelodyLibrary* library, uint32_t offset, uint64_t length) {
+    return offset <= library->size && length <= library->size - offset;
+}
+
+static void unmap(MelodyLibrary* library) {
+#ifdef _WIN32
+    if (library->data) UnmapViewOfFile(library->data);
+    if (library->mapping) CloseHandle(library->mapping);
+    if (library->file != INVALID_HANDLE_VALUE) CloseHandle(library->file);
+#else
+    if (library->data) munmap((void*)library->data, library->size);
+#endif
+    delete library;
+}
+
+// 整个文件只读映射到 library->data
+static bool map_file(MelodyLibrary* library, const char* path) {
+#ifdef _WIN32
+    library->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (library->file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(library->file, &size) || size.QuadPart < LIBRARY_HEADER_SIZE || size.QuadPart > 0xFFFFFFFFll) return false;
+    library->size = (uint32_t)size.QuadPart;
+    library->mapping = CreateFileMappingA(library->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (library->mapping == NULL) return false;
+    library->data = (const uint8_t*)MapViewOfFile(library->mapping, FILE_MAP_READ, 0, 0, 0);
+    return library->data != NULL;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size >= LIBRARY_HEADER_SIZE && (uint64_t)st.st_size <= 0xFFFFFFFFull;
+    if (ok) {
+        library->size = (uint32_t)st.st_size;
+        void* data = mmap(NULL, library->size, PROT_READ, MAP_SHARED, fd, 0);
+        ok = data != MAP_FAILED;
+        if (ok) library->data = (const uint8_t*)data;
+    }
+    close(fd); // 映射在关闭文件后仍然有效
+    return ok;
+#endif
+}
+
+extern "C" {
+
+bool melodyLibraryWrite(const char* path, const melody_library_source_t* melodies, uint32_t count, uint8_t resolution) {
+    if (resolution < 1 || resolution > 20 || (count > 0 && melodies == NULL) || count > 0x10000000u) {
+        log_e("melodyLibraryWrite: Invalid arguments.");
+        return false;
+    }
+    // 全库共用的频率表
+    std::vector<uint32_t> frequencies;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (melodies[i].notes == NULL) continue; // 下面逐个检查时报错
+        for (uint32_t j = 0; j < melodies[i].count; ++j) {
+            if (melodies[i].notes[j].frequency != 0) frequencies.push_back(melodies[i].notes[j].frequency);
+        }
+    }
+    std::sort(frequencies.begin(), frequencies.end());
+    frequencies.erase(std::unique(frequencies.begin(), frequencies.end()), frequencies.end());
+
+    uint32_t slot_count = 1;
+    while (slot_count < 2 * count) slot_count <<= 1;
+
+    uint32_t frequency_offset = LIBRARY_HEADER_SIZE;
+    uint32_t entry_offset = frequency_offset + 4 * (uint32_t)frequencies.size();
+    uint32_t id_slot_offset = entry_offset + LIBRARY_ENTRY_SIZE * count;
+    uint32_t name_slot_offset = id_slot_offset + 4 * slot_count;
+    std::vector<uint8_t> out(name_slot_offset + 4 * slot_count, 0);
+
+    memcpy(&out[0], k_magic, 4);
+    put_u16(out, 4, MELODY_LIBRARY_VERSION);
+    put_u16(out, 6, LIBRARY_HEADER_SIZE);
+    put_u32(out, 12, count);
+    put_u32(out, 16, (uint32_t)frequencies.size());
+    put_u32(out, 20, frequency_offset);
+    put_u32(out, 24, entry_offset);
+    put_u32(out, 28, slot_count);
+    put_u32(out, 32, id_slot_offset);
+    put_u32(out, 36, name_slot_offset);
+    out[40] = resolution;
+    for (size_t i = 0; i < frequencies.size(); ++i) put_u32(out, frequency_offset + 4 * i, frequencies[i]);
+
+    std::set<uint32_t> ids;
+    std::set<std::string> names;
+    uint32_t mask = slot_count - 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        const melody_library_source_t& melody = melodies[i];
+        size_t name_length = melody.name ? strlen(melody.name) : 0;
+        if (name_length == 0 || name_length > MELODY_LIBRARY_MAX_NAME || melody.count == 0 ||
+            melody.count > MELODY_LIBRARY_MAX_NOTES || melody.notes == NULL) {
+            log_e("melodyLibraryWrite: Melody %u has an invalid name or note count.", i);
+            return false;
+        }
+        if (!ids.insert(melody.id).second || !names.insert(std::string(melody.name, name_length)).second) {
+            log_e("melodyLibraryWrite: Duplicate id %u or name '%s'.", melody.id, melody.name);
+            return false;
+        }
+
+        uint32_t name_offset = (uint32_t)out.size();
+        out.insert(out.end(), melody.name, melody.name + name_length);
+        uint32_t data_offset = (uint32_t)out.size();
+        uint32_t duty = 1u << (resolution - 1);
+        uint32_t previous_ms = 0;
+        uint64_t duration_ms = 0;
+        for (uint32_t j = 0; j < melody.count; ++j) {
+            const ledc_sim_note_t& note = melody.notes[j];
+            uint32_t code = 0;
+            if (note.frequency != 0) {
+                code = (uint32_t)(std::lower_bound(frequencies.begin(), frequencies.end(), note.frequency) - frequencies.begin()) + 1;
+            }
+            bool duty_changed = note.frequency != 0 && note.duty != duty;
+            append_varint(out, (code << 1) | (duty_changed ? 1u : 0u));
+            if (duty_changed) {
+                duty = note.duty;
+                append_varint(out, duty);
+            }
+            append_varint(out, zigzag((int32_t)(note.duration_ms - previous_ms)));
+            append_varint(out, note.gap_ms);
+            previous_ms = note.duration_ms;
+            duration_ms += (uint64_t)note.duration_ms + note.gap_ms;
+        }
+        if (out.size() > 0xFFFFFFFFull || duration_ms > 0xFFFFFFFFull) {
+            log_e("melodyLibraryWrite: Library exceeds 4 GiB or melody '%s' is too long.", melody.name);
+            return false;
+        }
+
+        size_t entry = entry_offset + (size_t)i * LIBRARY_ENTRY_SIZE;
+        put_u32(out, entry, melody.id);
+        put_u32(out, entry + 4, name_offset);
+        put_u32(out, entry + 8, data_offset);
+        put_u32(out, entry + 12, (uint32_t)out.size() - data_offset);
+        put_u32(out, entry + 16, (uint32_t)duration_ms);
+        put_u16(out, entry + 20, (uint16_t)melody.count);
+        out[entry + 22] = (uint8_t)name_length;
+
+        uint32_t slot = hash_id(melody.id) & mask;
+        while (read_u32(&out[id_slot_offset + 4 * slot]) != 0) slot = (slot + 1) & mask;
+        put_u32(out, id_slot_offset + 4 * slot, i + 1);
+        slot = hash_name(melody.name, name_length) & mask;
+        while (read_u32(&out[name_slot_offset + 4 * slot]) != 0) slot = (slot + 1) & mask;
+        put_u32(out, name_slot_offset + 4 * slot, i + 1);
+    }
+    put_u32(out, 8, (uint32_t)out.size());
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        log_e("melodyLibraryWrite: Cannot open %s.", path);
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) log_e("melodyLibraryWrite: Failed to write %s.", path);
+    return ok;
+}
+
+MelodyLibrary* melodyLibraryOpen(const char* path) {
+    MelodyLibrary* library = new MelodyLibrary();
+#ifdef _WIN32
+    library->file = INVALID_HANDLE_VALUE;
+#endif
+    if (path == NULL || !map_file(library, path)) {
+        log_e("melodyLibraryOpen: Cannot map %s.", path ? path : "(null)");
+        unmap(library);
+        return NULL;
+    }
+    const uint8_t* h = library->data;
+    if (memcmp(h, k_magic, 4) != 0 || read_u16(h + 4) != MELODY_LIBRARY_VERSION || read_u16(h + 6) < LIBRARY_HEADER_SIZE ||
+        read_u32(h + 8) != library->size) {
+        log_e("melodyLibraryOpen: %s is not a version %d melody library.", path, MELODY_LIBRARY_VERSION);
+        unmap(library);
+        return NULL;
+    }
+    library->entry_count = read_u32(h + 12);
+    library->frequency_count = read_u32(h + 16);
+    library->frequency_offset = read_u32(h + 20);
+    library->entry_offset = read_u32(h + 24);
+    uint32_t slot_count = read_u32(h + 28);
+    library->slot_mask = slot_count - 1;
+    library->id_slot_offset = read_u32(h + 32);
+    library->name_slot_offset = read_u32(h + 36);
+    library->resolution = h[40];
+    // 只检查各张表的范围，单个旋律在使用时才检查
+    bool ok = slot_count != 0 && (slot_count & (slot_count - 1)) == 0 && slot_count / 2 >= library->entry_count &&
+              library->resolution >= 1 && library->resolution <= 20 &&
+              in_file(library, library->frequency_offset, 4ull * library->frequency_count) &&
+              in_file(library, library->entry_offset, (uint64_t)LIBRARY_ENTRY_SIZE * library->entry_count) &&
+              in_file(library, library->id_slot_offset, 4ull * slot_count) &&
+              in_file(library, library->name_slot_offset, 4ull * slot_count);
+    if (!ok) {
+        log_e("melodyLibraryOpen: %s has a corrupt header.", path);
+        unmap(library);
+        return NULL;
+    }
+    log_d("melodyLibraryOpen: Mapped %s (%u melodies, %u frequencies, %u bytes)", path, library->entry_count,
+          library->frequency_count, library->size);
+    return library;
+}
+
+void melodyLibraryClose(MelodyLibrary* library) {
+    if (library) unmap(library);
+}
+
+uint32_t melodyLibraryCount(const MelodyLibrary* library) {
+    return library ? library->entry_count : 0;
+}
+
+uint8_t melodyLibraryResolution(const MelodyLibrary* library) {
+    return library ? library->resolution : 0;
+}
+
+int32_t melodyLibraryFindId(const MelodyLibrary* library, uint32_t id) {
+    if (library == NULL || library->entry_count == 0) return -1;
+    const uint8_t* slots = library->data + library->id_slot_offset;
+    // 槽数至少是旋律数的两倍，一定有空槽，探测会停下
+    for (uint32_t slot = hash_id(id) & library->slot_mask;; slot = (slot + 1) & library->slot_mask) {
+        uint32_t value = read_u32(slots + 4 * slot);
+        if (value == 0 || value > library->entry_count) return -1;
+        if (read_u32(entry_at(library, value - 1)) == id) return (int32_t)(value - 1);
+    }
+}
+
+int32_t melodyLibraryFindName(const MelodyLibrary* library, const char* name) {
+    if (library == NULL || name == NULL || library->entry_count == 0) return -1;
+    size_t length = strlen(name);
+    const uint8_t* slots = library->data + library->name_slot_offset;
+    for (uint32_t slot = hash_name(name, length) & library->slot_mask;; slot = (slot + 1) & library->slot_mask) {
+        uint32_t value = read_u32(slots + 4 * slot);
+        if (value == 0 || value > library->entry_count) return -1;
+        const uint8_t* entry = entry_at(library, value - 1);
+        uint32_t name_offset = read_u32(entry + 4);
+        if (entry[22] == length && in_file(library, name_offset, length) &&
+            memcmp(library->data + name_offset, name, length) == 0) {
+            return (int32_t)(value - 1);
+        }
+    }
+}
+
+bool melodyLibraryGetInfo(const MelodyLibrary* library, uint32_t index, melody_library_info_t* info) {
+    if (library == NULL || info == NULL || index >= library->entry_count) return false;
+    const uint8_t* entry = entry_at(library, index);
+    uint32_t name_offset = read_u32(entry + 4);
+    if (!in_file(library, name_offset, entry[22])) return false;
+    info->id = read_u32(entry);
+    info->name = (const char*)library->data + name_offset;
+    info->name_length = entry[22];
+    info->note_count = read_u16(entry + 20);
+    info->duration_ms = read_u32(entry + 16);
+    return true;
+}
+
+int32_t melodyLibraryDecode(const MelodyLibrary* library, uint32_t index, ledc_sim_note_t* notes, uint32_t max_notes) {
+    if (library == NULL || index >= library->entry_count) return -1;
+    const uint8_t* entry = entry_at(library, index);
+    uint32_t data_offset = read_u32(entry + 8);
+    uint32_t data_length = read_u32(entry + 12);
+    uint16_t count = read_u16(entry + 20);
+    if (!in_file(library, data_offset, data_length)) return -1;
+
+    const uint8_t* p = library->data + data_offset;
+    const uint8_t* end = p + data_length;
+    const uint8_t* frequencies = library->data + library->frequency_offset;
+    uint32_t duty = 1u << (library->resolution - 1);
+    uint32_t duration_ms = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t token, delta, gap_ms;
+        if (!read_varint(p, end, token)) return -1;
+        if ((token & 1) && !read_varint(p, end, duty)) return -1;
+        if (!read_varint(p, end, delta) || !read_varint(p, end, gap_ms)) return -1;
+        uint32_t code = token >> 1;
+        if (code > library->frequency_count) return -1;
+        duration_ms += (uint32_t)unzigzag(delta);
+        if (notes != NULL && i < max_notes) {
+            ledc_sim_note_t& note = notes[i];
+            note.frequency = code ? read_u32(frequencies + 4 * (code - 1)) : 0;
+            note.duty = code ? duty : 0;
+            note.duration_ms = duration_ms;
+            note.gap_ms = gap_ms;
+        }
+    }
+    return p == end ? (int32_t)count : -1;
+}
+
+uint32_t melodyLibraryPlay(const MelodyLibrary* library, uint32_t index, uint8_t pin, uint32_t repeat) {
+    melody_library_info_t info;
+    std::vector<ledc_sim_note_t> notes;
+    if (melodyLibraryGetInfo(library, index, &info)) {
+        notes.resize(info.note_count);
+        if (melodyLibraryDecode(library, index, notes.data(), info.note_count) != (int32_t)info.note_count) notes.clear();
+    }
+    if (notes.empty()) {
+        log_e("melodyLibraryPlay: Melody %u is missing or corrupt.", index);
+        return 0;
+    }
+    return ledcSimPlaySequence(pin, notes.data(), (uint32_t)notes.size(), repeat);
+}
+
+} // extern "C"
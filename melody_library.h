@@ -0,0 +1,143 @@
+#ifndef _MELODY_LIBRARY_H_
+#define _MELODY_LIBRARY_H_
+
+// 二进制旋律库：把大量提示音（每个产品型号几十上百个）存成一个紧凑的文件，
+// 打开时整个文件映射到内存，不读入、不解析，打开和按名称 / ID 查找的开销与库的大小无关。
+//
+// 文件格式（版本 1，所有整数都是小端序，偏移量都相对文件开头）：
+//
+//   文件头，48 字节
+//     0  char[4] 魔数 "BZML"
+//     4  u16     版本号，主版本不同的文件拒绝打开
+//     6  u16     文件头长度，以后的版本可以在后面追加字段
+//     8  u32     文件长度
+//     12 u32     旋律数
+//     16 u32     频率表的项数
+//     20 u32     频率表的偏移：u32 频率（Hz），升序，全库共用
+//     24 u32     旋律表的偏移：每个旋律 24 字节，见下
+//     28 u32     两张散列表的槽数，2 的幂，至少是旋律数的两倍
+//     32 u32     ID 散列表的偏移：u32 槽，存旋律序号 + 1，0 为空，线性探测
+//     36 u32     名称散列表的偏移：格式相同，按名称的 FNV-1a 散列
+//     40 u8      占空比使用的分辨率（位），播放的引脚必须用相同的分辨率附加
+//     41 u8[7]   保留，为 0
+//
+//   旋律表项，24 字节
+//     0  u32 ID
+//     4  u32 名称的偏移（不以 '\0' 结尾）
+//     8  u32 音符数据的偏移
+//     12 u32 音符数据的长度
+//     16 u32 总时长（毫秒，含间隔）
+//     20 u16 音符数
+//     22 u8  名称长度
+//     23 u8  保留
+//
+//   音符数据：每个音符依次是以下几个 LEB128 变长整数
+//     (频率编号 << 1) | 占空比是否改变；频率编号 0 为休止符，n 为频率表第 n - 1 项
+//     新的占空比（仅当上一项的最低位为 1）；初始为 50%
+//     时长与上一个音符之差（毫秒，zigzag 编码）；第一个音符与 0 相比
+//     音符之后的静音（毫秒）
+//
+// 典型的提示音每个音符只占 3 个字节。打开文件时只检查文件头和各张表的范围，
+// 旋律数据在查找和播放时才逐项检查，损坏的条目只影响它自己。
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp32-hal-ledc-sim.h"
+
+#define MELODY_LIBRARY_VERSION  1
+#define MELODY_LIBRARY_MAX_NAME 255   // 名称的最大长度（字节）
+#define MELODY_LIBRARY_MAX_NOTES 65535 // 每个旋律的最多音符数
+
+typedef struct MelodyLibrary MelodyLibrary;
+
+// melodyLibraryWrite 的输入：一个旋律
+typedef struct {
+    uint32_t id;
+    const char* name;              // 以 '\0' 结尾，库内唯一
+    const ledc_sim_note_t* notes;  // 占空比按库的分辨率
+    uint32_t count;
+} melody_library_source_t;
+
+// 一个旋律的概要，name 指向映射的文件内部，库关闭前有效，不以 '\0' 结尾
+typedef struct {
+    uint32_t id;
+    const char* name;
+    uint8_t name_length;
+    uint16_t note_count;
+    uint32_t duration_ms;
+} melody_library_info_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 把一组旋律写成库文件，用于离线生成；频率表和散列表在这里建好，打开时不需要再处理。
+ *
+ * @param resolution 音符占空比使用的分辨率（1-20 位）。
+ * @return ID 或名称重复、名称或音符数超出限制、写文件失败时返回 false。
+ */
+bool melodyLibraryWrite(const char* path, const melody_library_source_t* melodies, uint32_t count, uint8_t resolution);
+
+/**
+ * @brief 打开库文件并映射到内存。只检查文件头和各张表的范围，与库的大小无关。
+ *
+ * @return 文件无法打开、不是旋律库或版本不支持时返回 NULL。
+ */
+MelodyLibrary* melodyLibraryOpen(const char* path);
+
+/**
+ * @brief 取消映射并关闭文件。之后 melody_library_info_t 中的名称不再有效。
+ */
+void melodyLibraryClose(MelodyLibrary* library);
+
+uint32_t melodyLibraryCount(const MelodyLibrary* library);
+
+/**
+ * @brief 库中占空比使用的分辨率，播放的引脚应当以此分辨率附加。
+ */
+uint8_t melodyLibraryResolution(const MelodyLibrary* library);
+
+/**
+ * @brief 按 ID 查找旋律。
+ *
+ * @return 旋律的序号，找不到时返回 -1。
+ */
+int32_t melodyLibraryFindId(const MelodyLibrary* library, uint32_t id);
+
+/**
+ * @brief 按名称查找旋律，名称直接与映射的文件比较，不复制。
+ *
+ * @return 旋律的序号，找不到时返回 -1。
+ */
+int32_t melodyLibraryFindName(const MelodyLibrary* library, const char* name);
+
+/**
+ * @brief 读取第 index 个旋律的概要。
+ *
+ * @return 序号超出范围或表项损坏时返回 false。
+ */
+bool melodyLibraryGetInfo(const MelodyLibrary* library, uint32_t index, melody_library_info_t* info);
+
+/**
+ * @brief 把第 index 个旋律解码成 ledcSimPlaySequence 使用的音符数组。
+ *
+ * @param notes 输出数组，可以为 NULL（只校验）。
+ * @param max_notes notes 的容量；音符更多时只写入前 max_notes 个，返回值仍是总数。
+ * @return 音符总数，序号超出范围或数据损坏时返回 -1。
+ */
+int32_t melodyLibraryDecode(const MelodyLibrary* library, uint32_t index, ledc_sim_note_t* notes, uint32_t max_notes);
+
+/**
+ * @brief 在已附加的引脚上播放第 index 个旋律：直接从映射的文件解码，交给 ledcSimPlaySequence。
+ *
+ * @param repeat 播放次数，0 表示无限循环直到 ledcSimStopSequence。
+ * @return 序列的序号，可用 ledcSimWaitToneGate 等待它结束；数据损坏或引脚未附加时返回 0。
+ */
+uint32_t melodyLibraryPlay(const MelodyLibrary* library, uint32_t index, uint8_t pin, uint32_t repeat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MELODY_LIBRARY_H_ */
@@ -0,0 +1,570 @@
+#include "midi_player.h"
+#include "esp32-hal-ledc.h"
+#include "esp32-hal-ledc-sim.h"
+#include "sim_clock.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define MIDI_TRACK_BUFFER     256        // 每个音轨的读缓冲区（字节）
+#define MIDI_LOOKAHEAD_NS     100000000ull // 事件提前提交的时间，远大于线程唤醒的抖动
+#define MIDI_DEFAULT_TEMPO    500000     // 每个四分音符的微秒数（120 BPM）
+#define MIDI_PERCUSSION       9          // MIDI 第 10 通道
+#define MIDI_VOICE_FREQ       1000
+#define MIDI_VOICE_RESOLUTION 10
+
+// 一个音轨的读取状态。音轨数据留在文件里，按需读入缓冲区
+struct MidiTrackReader {
+    long start;              // 音轨数据在文件中的起止位置
+    long end;
+    long offset;             // 下一次填充缓冲区的文件位置
+    uint8_t buffer[MIDI_TRACK_BUFFER];
+    uint32_t pos;
+    uint32_t len;
+    uint64_t next_tick;      // 下一个事件的绝对 tick
+    uint8_t running_status;
+    bool done;
+};
+
+struct MidiVoice {
+    bool active;
+    bool sustained;  // 键已松开，但延音踏板还踩着
+    uint8_t channel; // MIDI 通道
+    uint8_t note;
+    uint64_t age;    // 开始发声的顺序，用于选择被抢占的声部
+};
+
+// 播放线程读出的一个通道事件
+struct MidiEvent {
+    uint64_t time_us;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+struct MidiPlayer {
+    FILE* file;
+    std::vector<MidiTrackReader> tracks;
+    uint16_t division;       // 每个四分音符的 tick 数；SMPTE 时间码时最高位为 1
+
+    // 速度表：tempo_tick 处的时间为 tempo_us，之后每个四分音符 tempo 微秒
+    uint32_t tempo;
+    uint64_t tempo_tick;
+    uint64_t tempo_us;
+    uint64_t last_us;        // 最后一个读出的事件（包括元事件）的时间
+
+    uint8_t pins[MIDI_MAX_VOICES];
+    uint8_t voice_count;
+    bool percussion;
+    MidiVoice voices[MIDI_MAX_VOICES];
+    uint64_t voice_age;
+    bool sustain[16];        // 各 MIDI 通道的延音踏板
+
+    std::atomic<uint32_t> notes;
+    std::atomic<uint32_t> stolen;
+    std::atomic<uint32_t> max_active;
+    std::atomic<uint32_t> skipped;
+    std::atomic<uint32_t> position_ms;
+
+    std::thread thread;
+    std::atomic<bool> stop_requested;
+    SimClockWaiter* stop_waiter;
+    std::mutex mutex;
+    bool finished;                            // 受 mutex 保护
+    std::vector<SimClockWaiter*> waiters;     // 在 midiPlayerWait 中等待的线程，受 mutex 保护
+};
+
+// --- 文件读取 ---
+
+static bool read_exact(FILE* file, uint8_t* dst, size_t n) {
+    return fread(dst, 1, n, file) == n;
+}
+
+static uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static bool track_fill(MidiPlayer& player, MidiTrackReader& track) {
+    if (track.offset >= track.end) return false;
+    size_t n = (size_t)std::min<long>(MIDI_TRACK_BUFFER, track.end - track.offset);
+    if (fseek(player.file, track.offset, SEEK_SET) != 0 || !read_exact(player.file, track.buffer, n)) return false;
+    track.offset += (long)n;
+    track.pos = 0;
+    track.len = (uint32_t)n;
+    return true;
+}
+
+static bool track_byte(MidiPlayer& player, MidiTrackReader& track, uint8_t& value) {
+    if (track.pos == track.len && !track_fill(player, track)) return false;
+    value = track.buffer[track.pos++];
+    return true;
+}
+
+static bool track_skip(MidiTrackReader& track, uint32_t n) {
+    uint32_t buffered = track.len - track.pos;
+    if (n <= buffered) {
+        track.pos += n;
+        return true;
+    }
+    n -= buffered;
+    track.pos = track.len;
+    if ((long)n > track.end - track.offset) return false;
+    track.offset += (long)n;
+    return true;
+}
+
+// 可变长度数，最多 4 个字节
+static bool track_varlen(MidiPlayer& player, MidiTrackReader& track, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        uint8_t b;
+        if (!track_byte(player, track, b)) return false;
+        value = (value << 7) | (b & 0x7F);
+        if ((b & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// 读取下一个事件之前的 delta time，音轨结束或数据损坏时标记为已结束
+static void track_advance(MidiPlayer& player, MidiTrackReader& track) {
+    uint32_t delta;
+    if (!track_varlen(player, track, delta)) {
+        track.done = true;
+        return;
+    }
+    track.next_tick += delta;
+}
+
+static void track_rewind(MidiPlayer& player, MidiTrackReader& track) {
+    track.offset = track.start;
+    track.pos = 0;
+    track.len = 0;
+    track.next_tick = 0;
+    track.running_status = 0;
+    track.done = false;
+    track_advance(player, track);
+}
+
+static uint64_t tick_to_us(const MidiPlayer& player, uint64_t tick) {
+    if (player.division & 0x8000) {
+        // SMPTE：高字节是负的帧率（-29 表示 29.97），低字节是每帧的 tick 数
+        uint32_t fps = (uint32_t)(-(int8_t)(player.division >> 8));
+        uint32_t ticks_per_frame = player.division & 0xFF;
+        uint64_t centi_fps = fps == 29 ? 2997 : fps * 100;
+        return tick * 100000000ull / (centi_fps * ticks_per_frame);
+    }
+    return player.tempo_us + (tick - player.tempo_tick) * player.tempo / player.division;
+}
+
+// 按时间顺序读出下一个通道事件（各音轨合并，同一 tick 时编号小的音轨在前）。
+// 速度变化在这里直接更新速度表。文件读完返回 false
+static bool next_event(MidiPlayer& player, MidiEvent& event) {
+    for (;;) {
+        MidiTrackReader* track = nullptr;
+        for (MidiTrackReader& t : player.tracks) {
+            if (!t.done && (track == nullptr || t.next_tick < track->next_tick)) track = &t;
+        }
+        if (track == nullptr) return false;
+
+        uint64_t time_us = tick_to_us(player, track->next_tick);
+        player.last_us = std::max(player.last_us, time_us);
+        uint8_t status;
+        if (!track_byte(player, *track, status)) {
+            track->done = true;
+            continue;
+        }
+        bool running = status < 0x80;
+        if (running) {
+            if (track->running_status == 0) {
+                log_w("midiPlayer: Data byte without running status, dropping the rest of the track.");
+                track->done = true;
+                continue;
+            }
+            --track->pos; // 这个字节是第一个数据字节
+            status = track->running_status;
+        }
+
+        if (status == 0xFF) {
+            // 元事件：只关心速度和音轨结束
+            uint8_t type;
+            uint32_t length;
+            if (!track_byte(player, *track, type) || !track_varlen(player, *track, length)) {
+                track->done = true;
+                continue;
+            }
+            track->running_status = 0;
+            if (type == 0x2F) {
+                track->done = true;
+                continue;
+            }
+            if (type == 0x51 && length == 3 && !(player.division & 0x8000)) {
+                uint8_t b[3];
+                if (!track_byte(player, *track, b[0]) || !track_byte(player, *track, b[1]) || !track_byte(player, *track, b[2])) {
+                    track->done = true;
+                    continue;
+                }
+                player.tempo_us = time_us;
+                player.tempo_tick = track->next_tick;
+                player.tempo = ((uint32_t)b[0] << 16) | ((uint32_t)b[1] << 8) | b[2];
+                if (player.tempo == 0) player.tempo = MIDI_DEFAULT_TEMPO;
+            } else if (!track_skip(*track, length)) {
+                track->done = true;
+                continue;
+            }
+            track_advance(player, *track);
+            continue;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+            uint32_t length;
+            if (!track_varlen(player, *track, length) || !track_skip(*track, length)) {
+                track->done = true;
+                continue;
+            }
+            track->running_status = 0;
+            track_advance(player, *track);
+            continue;
+        }
+        if (status >= 0xF0) {
+            log_w("midiPlayer: Unexpected status 0x%02X, dropping the rest of the track.", status);
+            track->done = true;
+            continue;
+        }
+
+        // 通道消息：程序变化和通道压力只有一个数据字节
+        track->running_status = status;
+        uint8_t kind = status & 0xF0;
+        event.time_us = time_us;
+        event.status = status;
+        event.data2 = 0;
+        if (!track_byte(player, *track, event.data1) ||
+            (kind != 0xC0 && kind != 0xD0 && !track_byte(player, *track, event.data2))) {
+            track->done = true;
+            continue;
+        }
+        track_advance(player, *track);
+        return true;
+    }
+}
+
+// --- 声部分配 ---
+
+static uint32_t note_frequency(uint8_t note) {
+    return (uint32_t)std::lround(440.0 * std::pow(2.0, (note - 69) / 12.0));
+}
+
+static void voice_off(MidiPlayer& player, int v) {
+    player.voices[v].active = false;
+    player.voices[v].sustained = false;
+    ledcSimWriteToneGated(player.pins[v], 0, 0);
+}
+
+static void note_on(MidiPlayer& player, uint8_t channel, uint8_t note) {
+    // 同一个音重新按下时沿用原来的声部；否则依次选择空闲声部、只靠延音踏板维持的最早的声部、最早开始的声部
+    int same = -1;
+    int idle = -1;
+    int oldest_sustained = -1;
+    int oldest = -1;
+    uint32_t active = 0;
+    for (int v = 0; v < player.voice_count; ++v) {
+        const MidiVoice& voice = player.voices[v];
+        if (!voice.active) {
+            if (idle == -1) idle = v;
+            continue;
+        }
+        ++active;
+        if (voice.channel == channel && voice.note == note) same = v;
+        if (voice.sustained && (oldest_sustained == -1 || voice.age < player.voices[oldest_sustained].age)) {
+            oldest_sustained = v;
+        }
+        if (oldest == -1 || voice.age < player.voices[oldest].age) oldest = v;
+    }
+    int found;
+    if (same != -1) {
+        found = same;
+        --active;
+    } else if (idle != -1) {
+        found = idle;
+    } else {
+        found = oldest_sustained != -1 ? oldest_sustained : oldest;
+        ++player.stolen;
+        --active;
+    }
+    MidiVoice& voice = player.voices[found];
+    voice.active = true;
+    voice.sustained = false;
+    voice.channel = channel;
+    voice.note = note;
+    voice.age = player.voice_age++;
+    ledcSimWriteToneGated(player.pins[found], note_frequency(note), 0);
+    ++player.notes;
+    if (active + 1 > player.max_active) player.max_active = active + 1;
+}
+
+static void note_off(MidiPlayer& player, uint8_t channel, uint8_t note) {
+    for (int v = 0; v < player.voice_count; ++v) {
+        MidiVoice& voice = player.voices[v];
+        if (voice.active && voice.channel == channel && voice.note == note) {
+            if (player.sustain[channel]) {
+                voice.sustained = true;
+            } else {
+                voice_off(player, v);
+            }
+            return;
+        }
+    }
+}
+
+static void handle_event(MidiPlayer& player, const MidiEvent& event) {
+    uint8_t channel = event.status & 0x0F;
+    switch (event.status & 0xF0) {
+        case 0x90:
+            if (event.data2 == 0) { // 力度为 0 的 note on 就是 note off
+                note_off(player, channel, event.data1 & 0x7F);
+            } else if (channel == MIDI_PERCUSSION && !player.percussion) {
+                ++player.skipped;
+            } else {
+                note_on(player, channel, event.data1 & 0x7F);
+            }
+            break;
+        case 0x80:
+            note_off(player, channel, event.data1 & 0x7F);
+            break;
+        case 0xB0:
+            if (event.data1 == 64) { // 延音踏板
+                player.sustain[channel] = event.data2 >= 64;
+                if (!player.sustain[channel]) {
+                    for (int v = 0; v < player.voice_count; ++v) {
+                        if (player.voices[v].active && player.voices[v].sustained && player.voices[v].channel == channel) {
+                            voice_off(player, v);
+                        }
+                    }
+                }
+            } else if (event.data1 == 120 || event.data1 == 123) { // 全部静音 / 全部音符关闭
+                player.sustain[channel] = false;
+                for (int v = 0; v < player.voice_count; ++v) {
+                    if (player.voices[v].active && player.voices[v].channel == channel) voice_off(player, v);
+                }
+            }
+            break;
+        default:
+            break; // 弯音、程序变化等蜂鸣器无法表现的消息
+    }
+}
+
+// --- 播放线程 ---
+
+// 等到 time_ns，midiPlayerStop 会提前唤醒。被停止时返回 false
+static bool wait_until(MidiPlayer& player, uint64_t time_ns) {
+    while (!player.stop_requested.load()) {
+        if (simClockNowNs() >= time_ns) return true;
+        simClockWaiterWait(player.stop_waiter, time_ns); // 切换时钟模式会提前返回，重新检查即可
+    }
+    return false;
+}
+
+static void player_main(MidiPlayer* player) {
+    // 第一批事件也提前提交，开头的音符不会因为线程启动而推迟
+    uint64_t start_ns = simClockNowNs() + MIDI_LOOKAHEAD_NS;
+    MidiEvent event;
+    bool stopped = false;
+    while (next_event(*player, event)) {
+        uint64_t when = start_ns + event.time_us * 1000;
+        if (!wait_until(*player, when - MIDI_LOOKAHEAD_NS)) {
+            stopped = true;
+            break;
+        }
+        player->position_ms = (uint32_t)(event.time_us / 1000);
+        ledcSimScheduleAt(when);
+        handle_event(*player, event);
+    }
+
+    if (!stopped) {
+        // 文件结束（最后一个音轨结束的时刻）时关闭仍在发声的声部，再等到那一刻
+        uint64_t end_ns = start_ns + player->last_us * 1000;
+        ledcSimScheduleAt(end_ns);
+        for (int v = 0; v < player->voice_count; ++v) {
+            if (player->voices[v].active) voice_off(*player, v);
+        }
+        ledcSimScheduleAt(0);
+        player->position_ms = (uint32_t)(player->last_us / 1000);
+        stopped = !wait_until(*player, end_ns);
+    }
+    ledcSimScheduleAt(0);
+    if (stopped) {
+        // 取消已提前提交的音符并立即静音
+        for (int v = 0; v < player->voice_count; ++v) {
+            ledcSimStopSequence(player->pins[v]);
+            player->voices[v].active = false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(player->mutex);
+        player->finished = true;
+        for (SimClockWaiter* waiter : player->waiters) {
+            simClockWaiterNotify(waiter);
+        }
+    }
+    simClockThreadEnd();
+}
+
+extern "C" {
+
+MidiPlayer* midiPlayerOpen(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        log_e("midiPlayerOpen: Cannot open %s.", path);
+        return NULL;
+    }
+    uint8_t header[14];
+    if (!read_exact(file, header, sizeof(header)) || memcmp(header, "MThd", 4) != 0 || be32(header + 4) < 6) {
+        log_e("midiPlayerOpen: %s is not a standard MIDI file.", path);
+        fclose(file);
+        return NULL;
+    }
+    uint16_t format = be16(header + 8);
+    uint16_t track_count = be16(header + 10);
+    uint16_t division = be16(header + 12);
+    if (format > 1 || division == 0 || (division & 0x8000 && (division & 0xFF) == 0)) {
+        log_e("midiPlayerOpen: Unsupported MIDI format %u (division 0x%04X).", format, division);
+        fclose(file);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+
+    // 只记录各音轨的位置，跳过不认识的块
+    MidiPlayer* player = new MidiPlayer();
+    player->file = file;
+    player->division = division;
+    long pos = 8 + (long)be32(header + 4);
+    while (player->tracks.size() < track_count && pos + 8 <= file_size) {
+        uint8_t chunk[8];
+        fseek(file, pos, SEEK_SET);
+        if (!read_exact(file, chunk, sizeof(chunk))) break;
+        long length = (long)be32(chunk + 4);
+        if (memcmp(chunk, "MTrk", 4) == 0) {
+            MidiTrackReader track;
+            memset(&track, 0, sizeof(track));
+            track.start = pos + 8;
+            track.end = std::min(track.start + length, file_size);
+            if (track.end < track.start + length) log_w("midiPlayerOpen: Track %u is truncated.", (unsigned)player->tracks.size());
+            player->tracks.push_back(track);
+        }
+        pos += 8 + length;
+    }
+    if (player->tracks.empty()) {
+        log_e("midiPlayerOpen: %s has no tracks.", path);
+        fclose(file);
+        delete player;
+        return NULL;
+    }
+    player->stop_waiter = simClockWaiterCreate();
+    player->finished = true;
+    log_d("Opened %s: format %u, %u tracks, division %u", path, format, (unsigned)player->tracks.size(), division);
+    return player;
+}
+
+bool midiPlayerStart(MidiPlayer* player, const uint8_t* pins, uint8_t voices, bool percussion) {
+    if (pins == NULL || voices == 0 || voices > MIDI_MAX_VOICES) {
+        log_e("midiPlayerStart: Invalid voice count %u.", voices);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(player->mutex);
+        if (!player->finished) {
+            log_e("midiPlayerStart: Already playing.");
+            return false;
+        }
+    }
+    if (player->thread.joinable()) player->thread.join();
+
+    for (uint8_t v = 0; v < voices; ++v) {
+        if (!ledcAttachChannel(pins[v], MIDI_VOICE_FREQ, MIDI_VOICE_RESOLUTION, v)) {
+            while (v > 0) ledcDetach(pins[--v]);
+            return false;
+        }
+        player->pins[v] = pins[v];
+    }
+    player->voice_count = voices;
+    player->percussion = percussion;
+    memset(player->voices, 0, sizeof(player->voices));
+    memset(player->sustain, 0, sizeof(player->sustain));
+    player->voice_age = 0;
+    player->tempo = MIDI_DEFAULT_TEMPO;
+    player->tempo_tick = 0;
+    player->tempo_us = 0;
+    player->last_us = 0;
+    for (MidiTrackReader& track : player->tracks) {
+        track_rewind(*player, track);
+    }
+    player->notes = 0;
+    player->stolen = 0;
+    player->max_active = 0;
+    player->skipped = 0;
+    player->position_ms = 0;
+    player->stop_requested = false;
+    {
+        std::lock_guard<std::mutex> lock(player->mutex);
+        player->finished = false;
+    }
+
+    simClockThreadBegin(); // 在创建线程之前登记，虚拟时间不会在线程启动前推进
+    player->thread = std::thread(player_main, player);
+    return true;
+}
+
+bool midiPlayerWait(MidiPlayer* player, uint64_t deadline_ns) {
+    std::unique_lock<std::mutex> lock(player->mutex);
+    while (!player->finished && simClockNowNs() < deadline_ns) {
+        SimClockWaiter* waiter = simClockWaiterCreate();
+        player->waiters.push_back(waiter);
+        lock.unlock();
+        simClockWaiterWait(waiter, deadline_ns);
+        lock.lock();
+        for (size_t i = 0; i < player->waiters.size(); ++i) {
+            if (player->waiters[i] == waiter) {
+                player->waiters.erase(player->waiters.begin() + i);
+                break;
+            }
+        }
+        simClockWaiterDestroy(waiter);
+    }
+    return player->finished;
+}
+
+void midiPlayerStop(MidiPlayer* player) {
+    player->stop_requested = true;
+    simClockWaiterNotify(player->stop_waiter);
+    if (player->thread.joinable()) player->thread.join();
+}
+
+void midiPlayerGetStats(MidiPlayer* player, midi_player_stats_t* stats) {
+    stats->notes = player->notes;
+    stats->stolen = player->stolen;
+    stats->max_active = player->max_active;
+    stats->skipped = player->skipped;
+    stats->position_ms = player->position_ms;
+}
+
+void midiPlayerClose(MidiPlayer* player) {
+    if (player == NULL) return;
+    midiPlayerStop(player);
+    for (uint8_t v = 0; v < player->voice_count; ++v) {
+        ledcDetach(player->pins[v]);
+    }
+    simClockWaiterDestroy(player->stop_waiter);
+    fclose(player->file);
+    delete player;
+}
+
+} // extern "C"
@@ -0,0 +1,74 @@
+#ifndef _MIDI_PLAYER_H_
+#define _MIDI_PLAYER_H_
+
+// 标准 MIDI 文件（SMF，格式 0 / 1）的复音播放器。每个声部占用一个 LEDC 通道，
+// 音符按先来先得分配给空闲声部，声部不够时抢占最早开始的音符。
+// 播放线程边读文件边提前一小段时间提交事件（ledcSimScheduleAt），音符由渲染器按帧准确切换；
+// 每个音轨只有一个很小的读缓冲区，再大的文件也不会一次读入内存。
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MIDI_MAX_VOICES 16 // 与 LEDC 通道数相同
+
+typedef struct MidiPlayer MidiPlayer;
+
+// 播放统计
+typedef struct {
+    uint32_t notes;       // 已发声的音符数
+    uint32_t stolen;      // 因声部不够被抢占的音符数
+    uint32_t max_active;  // 同时发声的最多音符数
+    uint32_t skipped;     // 没有播放的打击乐音符数
+    uint32_t position_ms; // 已提交到的播放位置（毫秒）
+} midi_player_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 打开 MIDI 文件，只读取文件头和各音轨的位置，事件在播放时才读取。
+ *
+ * @return 文件无法打开或不是格式 0 / 1 的 SMF 时返回 NULL。
+ */
+MidiPlayer* midiPlayerOpen(const char* path);
+
+/**
+ * @brief 从头开始播放。第 i 个声部把 pins[i] 附加到 LEDC 通道 i，播放期间这些通道归播放器使用。
+ *        播放在后台线程中进行，调用立即返回；上一次播放结束或停止后可以再次调用。
+ *
+ * @param pins 每个声部使用的引脚。
+ * @param voices 声部数（1-MIDI_MAX_VOICES）。
+ * @param percussion 是否播放 MIDI 第 10 通道（打击乐）。蜂鸣器只能发出固定音高，默认应跳过。
+ * @return 正在播放、参数无效或引脚附加失败时返回 false。
+ */
+bool midiPlayerStart(MidiPlayer* player, const uint8_t* pins, uint8_t voices, bool percussion);
+
+/**
+ * @brief 等待播放结束（文件播完或被 midiPlayerStop 停止）。
+ *
+ * @param deadline_ns 最长等待到的时间（simClockNowNs 的时间基准），SIM_CLOCK_FOREVER 表示不限。
+ * @return 播放已结束返回 true，超时返回 false。
+ */
+bool midiPlayerWait(MidiPlayer* player, uint64_t deadline_ns);
+
+/**
+ * @brief 停止播放并立即静音，已经提前提交的音符也会被取消。引脚保持附加。
+ */
+void midiPlayerStop(MidiPlayer* player);
+
+/**
+ * @brief 读取本次播放的统计。
+ */
+void midiPlayerGetStats(MidiPlayer* player, midi_player_stats_t* stats);
+
+/**
+ * @brief 停止播放，分离引脚并关闭文件。
+ */
+void midiPlayerClose(MidiPlayer* player);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MIDI_PLAYER_H_ */
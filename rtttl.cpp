@@ -0,0 +1,255 @@
+#include "rtttl.h"
+#include "esp32-hal-ledc.h"
+#include "sim_clock.h"
+#include <cstring>
+
+// 时长以 1/128 全音符为单位累计：全音符是 4 拍，即 240000/bpm 毫秒，
+// 所以位置 t 对应 t * 1875 / bpm 毫秒，不需要浮点，也不会在长曲子里累积取整误差
+#define RTTTL_WHOLE_UNITS 128
+#define RTTTL_MAX_BPM     900
+
+static const char* skip_space(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+    return p;
+}
+
+static bool fail(rtttl_parser_t* parser, const char* where, const char* message) {
+    parser->error = message;
+    parser->error_offset = (size_t)(where - parser->text);
+    return false;
+}
+
+// 读取十进制数，没有数字时返回 false。过大的数被限制在 100000 以内，交给调用者按范围报错
+static bool parse_number(const char*& p, uint32_t& value) {
+    if (*p < '0' || *p > '9') return false;
+    value = 0;
+    while (*p >= '0' && *p <= '9') {
+        if (value < 100000) value = value * 10 + (uint32_t)(*p - '0');
+        ++p;
+    }
+    return true;
+}
+
+// 合法的时值：1, 2, 4, 8, 16, 32, 64
+static bool valid_duration(uint32_t duration) {
+    return duration != 0 && duration <= 64 && (duration & (duration - 1)) == 0;
+}
+
+static int lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+extern "C" {
+
+bool rtttlParserInit(rtttl_parser_t* parser, const char* text) {
+    memset(parser, 0, sizeof(*parser));
+    parser->default_duration = 4;
+    parser->default_octave = 6;
+    parser->bpm = 63;
+    if (text == NULL) {
+        parser->error = "no ringtone text";
+        return false;
+    }
+    parser->text = text;
+    parser->cursor = text;
+
+    // 名称：第一个 ':' 之前的所有字符
+    const char* p = text;
+    while (*p != '\0' && *p != ':') ++p;
+    if (*p == '\0') return fail(parser, p, "missing ':' after name");
+    parser->name = text;
+    parser->name_length = (size_t)(p - text);
+
+    // 默认值：逗号分隔的 d=、o=、b=，顺序任意，可以省略
+    p = skip_space(p + 1);
+    while (*p != ':') {
+        if (*p == '\0') return fail(parser, p, "missing ':' after defaults");
+        const char* key = p;
+        p = skip_space(p + 1);
+        if (*p != '=') return fail(parser, p, "expected '=' in defaults");
+        p = skip_space(p + 1);
+        const char* value_pos = p;
+        uint32_t value;
+        if (!parse_number(p, value)) return fail(parser, p, "expected a number in defaults");
+        switch (lower(*key)) {
+            case 'd':
+                if (!valid_duration(value)) return fail(parser, value_pos, "invalid default duration");
+                parser->default_duration = (uint16_t)value;
+                break;
+            case 'o':
+                if (value > 8) return fail(parser, value_pos, "default octave out of range (0-8)");
+                parser->default_octave = (uint8_t)value;
+                break;
+            case 'b':
+                if (value == 0 || value > RTTTL_MAX_BPM) return fail(parser, value_pos, "bpm out of range (1-900)");
+                parser->bpm = (uint16_t)value;
+                break;
+            default:
+                return fail(parser, key, "unknown default (expected d, o or b)");
+        }
+        p = skip_space(p);
+        if (*p == ',') {
+            p = skip_space(p + 1);
+        } else if (*p != ':' && *p != '\0') {
+            return fail(parser, p, "expected ',' or ':' in defaults");
+        }
+    }
+    parser->cursor = p + 1;
+    return true;
+}
+
+int rtttlParserNext(rtttl_parser_t* parser, rtttl_note_t* note) {
+    if (parser->error) return -1;
+    for (;;) {
+        // 音符格式：[时值] 音名 [#] [.] [八度] [.]，附点写在八度前后都可以
+        const char* p = skip_space(parser->cursor);
+        if (*p == '\0') {
+            parser->cursor = p;
+            return 0;
+        }
+        const char* start = p;
+        uint32_t duration = parser->default_duration;
+        if (parse_number(p, duration) && !valid_duration(duration)) {
+            fail(parser, start, "invalid duration (1, 2, 4, 8, 16, 32 or 64)");
+            return -1;
+        }
+        int semitone;
+        switch (lower(*p)) {
+            case 'c': semitone = NOTE_C; break;
+            case 'd': semitone = NOTE_D; break;
+            case 'e': semitone = NOTE_E; break;
+            case 'f': semitone = NOTE_F; break;
+            case 'g': semitone = NOTE_G; break;
+            case 'a': semitone = NOTE_A; break;
+            case 'b':
+            case 'h': semitone = NOTE_B; break; // 德式记法 h = b
+            case 'p': semitone = -1; break;     // 休止符
+            default:
+                fail(parser, p, "expected a note (a-g, h or p)");
+                return -1;
+        }
+        ++p;
+        if (*p == '#') {
+            if (semitone < 0) {
+                fail(parser, p, "a rest can not be sharp");
+                return -1;
+            }
+            ++semitone;
+            ++p;
+        }
+        bool dotted = false;
+        if (*p == '.') {
+            dotted = true;
+            ++p;
+        }
+        uint32_t octave = parser->default_octave;
+        const char* octave_pos = p;
+        if (parse_number(p, octave) && octave > 8) {
+            fail(parser, octave_pos, "octave out of range (0-8)");
+            return -1;
+        }
+        if (*p == '.') {
+            dotted = true;
+            ++p;
+        }
+        p = skip_space(p);
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0') {
+            fail(parser, p, "expected ',' between notes");
+            return -1;
+        }
+        parser->cursor = p;
+
+        uint32_t frequency = 0;
+        if (semitone >= 0) {
+            if (semitone == NOTE_MAX) { // b# 是高八度的 c
+                semitone = NOTE_C;
+                ++octave;
+            }
+            frequency = ledcSimNoteFrequency((note_t)semitone, (uint8_t)octave);
+            if (frequency == 0) {
+                fail(parser, start, "note above octave 8");
+                return -1;
+            }
+        }
+
+        uint32_t units = RTTTL_WHOLE_UNITS / duration;
+        if (dotted) units += units / 2;
+        parser->position += units;
+        uint64_t end_ms = (parser->position * 3750 + parser->bpm) / (2 * (uint64_t)parser->bpm); // 四舍五入
+        uint32_t duration_ms = (uint32_t)(end_ms - parser->emitted_ms);
+        if (duration_ms == 0) continue; // 不到半毫秒，时长留给下一个音符
+        parser->emitted_ms = end_ms;
+        note->frequency = frequency;
+        note->duration_ms = duration_ms;
+        return 1;
+    }
+}
+
+uint32_t rtttlPlay(uint8_t pin, const char* text) {
+    const char* error = NULL;
+    size_t error_offset = 0;
+    int32_t count = rtttlCompile(text, NULL, 0, 0, &error, &error_offset);
+    if (count < 0) {
+        log_e("rtttlPlay: %s at offset %u.", error, (unsigned)error_offset);
+        return 0;
+    }
+    if (count == 0) {
+        log_e("rtttlPlay: Ringtone has no notes.");
+        return 0;
+    }
+
+    rtttl_parser_t parser;
+    rtttl_note_t note;
+    rtttlParserInit(&parser, text);
+    // 已提交音符的序号，按提交顺序循环存放
+    uint32_t serials[RTTTL_PLAY_LOOKAHEAD];
+    uint32_t submitted = 0;
+    while (rtttlParserNext(&parser, &note) == 1) {
+        if (submitted >= RTTTL_PLAY_LOOKAHEAD) {
+            uint32_t last = serials[(submitted - 1) % RTTTL_PLAY_LOOKAHEAD];
+            ledcSimWaitToneGate(pin, serials[submitted % RTTTL_PLAY_LOOKAHEAD], SIM_CLOCK_FOREVER);
+            // 最早的音符播完时，最后提交的音符不可能也已结束，除非播放被中止或引脚已分离
+            if (ledcSimWaitToneGate(pin, last, 0)) {
+                log_d("rtttlPlay: Playback on pin %d stopped after %u notes.", pin, submitted);
+                return last;
+            }
+        }
+        uint32_t serial = ledcSimWriteToneGated(pin, note.frequency, note.duration_ms);
+        if (serial == 0) {
+            return 0;
+        }
+        serials[submitted % RTTTL_PLAY_LOOKAHEAD] = serial;
+        ++submitted;
+    }
+    log_d("rtttlPlay: Queued %.*s (%u notes, %llu ms) on pin %d", (int)parser.name_length, parser.name, submitted,
+          (unsigned long long)parser.emitted_ms, pin);
+    return serials[(submitted - 1) % RTTTL_PLAY_LOOKAHEAD];
+}
+
+int32_t rtttlCompile(const char* text, ledc_sim_note_t* notes, uint32_t max_notes, uint32_t duty, const char** error,
+                     size_t* error_offset) {
+    rtttl_parser_t parser;
+    rtttl_note_t note;
+    int32_t count = 0;
+    if (rtttlParserInit(&parser, text)) {
+        int result;
+        while ((result = rtttlParserNext(&parser, &note)) == 1) {
+            if (notes != NULL && (uint32_t)count < max_notes) {
+                ledc_sim_note_t& out = notes[count];
+                out.frequency = note.frequency;
+                out.duty = note.frequency != 0 ? duty : 0;
+                out.duration_ms = note.duration_ms;
+                out.gap_ms = 0;
+            }
+            ++count;
+        }
+        if (result == 0) return count;
+    }
+    if (error) *error = parser.error;
+    if (error_offset) *error_offset = parser.error_offset;
+    return -1;
+}
+
+} // extern "C"
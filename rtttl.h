@@ -0,0 +1,83 @@
+#ifndef _RTTTL_H_
+#define _RTTTL_H_
+
+// RTTTL（Nokia 铃声文本格式）解析与播放，例如 "Beep:d=4,o=5,b=120:8c,8e,g,p,2c6"。
+// 解析器是一个只读游标，直接在输入字符串上逐个产生音符，不分配内存；
+// 音高按 ledcWriteNote 的音符表（ledcSimNoteFrequency）计算，与固件里逐个 ledcWriteNote 播放的结果相同。
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp32-hal-ledc-sim.h"
+
+#define RTTTL_PLAY_LOOKAHEAD 128 // rtttlPlay 最多提前交给渲染器的音符数
+
+// 一个音符事件
+typedef struct {
+    uint32_t frequency;   // 频率（Hz），0 表示休止符
+    uint32_t duration_ms; // 时长（毫秒）
+} rtttl_note_t;
+
+// 解析状态，字段只读。name 指向输入字符串内部，不以 '\0' 结尾
+typedef struct {
+    const char* name;         // 铃声名称
+    size_t name_length;
+    uint16_t default_duration; // d=，默认 4（四分音符）
+    uint8_t default_octave;    // o=，默认 6
+    uint16_t bpm;              // b=，每分钟的四分音符数，默认 63
+    const char* text;          // 输入字符串的起点，用于计算错误位置
+    const char* cursor;        // 下一个音符的位置
+    uint64_t position;         // 已解析音符的累计时长，单位为 1/128 全音符（附点 64 分音符也是整数）
+    uint64_t emitted_ms;       // 已产生音符的总时长（毫秒）
+    const char* error;         // 错误说明，没有错误时为 NULL
+    size_t error_offset;       // 出错的字符在输入中的位置
+} rtttl_parser_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 解析名称和默认值段，把游标放在第一个音符上。text 在解析期间必须保持有效。
+ *
+ * @return 格式正确返回 true；否则返回 false，parser->error 说明原因。
+ */
+bool rtttlParserInit(rtttl_parser_t* parser, const char* text);
+
+/**
+ * @brief 取下一个音符。每个音符的毫秒时长按累计位置取整，长曲子不会累积误差；
+ *        取整后为 0 的极短音符会并入下一个音符的时长，不会产生。
+ *
+ * @return 1 表示取到音符，0 表示已经结束，-1 表示格式错误（parser->error 说明原因）。
+ */
+int rtttlParserNext(rtttl_parser_t* parser, rtttl_note_t* note);
+
+/**
+ * @brief 在已附加的引脚上播放铃声：边解析边把音符作为门控音符（ledcSimWriteToneGated）交给渲染器，
+ *        音符之间按帧无缝衔接。提前提交的音符不超过 RTTTL_PLAY_LOOKAHEAD 个，
+ *        只有更长的铃声才会让调用者等待前面的音符播完。ledcSimStopSequence 可以中止播放。
+ *        开始播放前先完整校验一遍，格式错误的铃声不会发出任何声音。
+ *
+ * @return 最后一个音符的序号，可用 ledcSimWaitToneGate 等待播放结束；格式错误、引脚未附加或铃声为空时返回 0。
+ */
+uint32_t rtttlPlay(uint8_t pin, const char* text);
+
+/**
+ * @brief 把铃声编译成 ledcSimPlaySequence 使用的音符数组，用于离线批量校验和预编译。
+ *        不分配内存，每个铃声只解析一遍。
+ *
+ * @param notes 输出数组，可以为 NULL（只校验并统计音符数）。
+ * @param max_notes notes 的容量；音符更多时只写入前 max_notes 个，返回值仍是总数。
+ * @param duty 发声音符的占空比（按播放引脚的分辨率，例如 10 位时 512 为 50%）。
+ * @param error 出错时写入错误说明（可以为 NULL）。
+ * @param error_offset 出错时写入出错位置（可以为 NULL）。
+ * @return 音符总数，格式错误时返回 -1。
+ */
+int32_t rtttlCompile(const char* text, ledc_sim_note_t* notes, uint32_t max_notes, uint32_t duty, const char** error,
+                     size_t* error_offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RTTTL_H_ */
@@ -0,0 +1,215 @@
+#include "sim_clock.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// --- 虚拟时间调度 ---
+// 每个参与线程的延时都登记为一个唤醒时刻。只要还有参与线程在运行，时间就停在原地；
+// 当所有参与线程都在延时中时，时间直接跳到最早的唤醒时刻（离散事件仿真），
+// 先通知渲染器补齐到这一时刻的音频，再唤醒到期的线程。
+
+struct VirtualSleeper {
+    uint64_t deadline; // SIM_CLOCK_FOREVER 表示只能被 simClockWaiterNotify 唤醒
+    bool woken;
+    std::condition_variable cv;
+};
+
+struct SimClockWaiter {
+    VirtualSleeper sleeper;
+    bool waiting;
+    bool pending;     // 已通知但尚未被 simClockWaiterWait 取走
+    bool interrupted; // 等待期间切换了时钟模式，期限已失去意义
+};
+
+static std::atomic<int> g_clock_mode(SIM_CLOCK_REAL);
+static std::atomic<uint64_t> g_virtual_now_ns(0);
+static std::atomic<sim_clock_advance_hook_t> g_advance_hook(nullptr);
+static std::atomic<sim_clock_reset_hook_t> g_reset_hook(nullptr);
+
+// 列表有意不析构：其他文件中后台线程的静态对象在程序退出时还要通知并等待线程结束，
+// 而不同文件的静态对象析构顺序不确定
+static std::mutex g_clock_mutex;
+static std::vector<VirtualSleeper*>& g_sleepers = *new std::vector<VirtualSleeper*>(); // 尚未到期的延时
+static int g_participants = 1;                                                        // 主线程默认参与
+static std::vector<SimClockWaiter*>& g_waiters = *new std::vector<SimClockWaiter*>();  // 所有可唤醒的等待对象
+
+static uint64_t real_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 所有参与线程都在延时中时推进时间，调用者必须持有 g_clock_mutex
+static void advance_locked() {
+    if (g_sleepers.empty() || (int)g_sleepers.size() < g_participants) {
+        return;
+    }
+    uint64_t next = g_sleepers[0]->deadline;
+    for (VirtualSleeper* s : g_sleepers) {
+        if (s->deadline < next) next = s->deadline;
+    }
+    if (next == SIM_CLOCK_FOREVER) {
+        return; // 所有线程都在等待通知，时间无处可去
+    }
+    if (next > g_virtual_now_ns.load(std::memory_order_relaxed)) {
+        sim_clock_advance_hook_t hook = g_advance_hook.load();
+        if (hook) hook(next);
+        g_virtual_now_ns.store(next, std::memory_order_release);
+    }
+    for (size_t i = 0; i < g_sleepers.size(); ) {
+        VirtualSleeper* s = g_sleepers[i];
+        if (s->deadline <= next) {
+            s->woken = true;
+            s->cv.notify_one();
+            g_sleepers[i] = g_sleepers.back();
+            g_sleepers.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+// 把等待对象从延时列表中摘下并唤醒，不推进时间，调用者必须持有 g_clock_mutex
+static void wake_waiter_locked(SimClockWaiter* waiter) {
+    VirtualSleeper& sleeper = waiter->sleeper;
+    for (size_t i = 0; i < g_sleepers.size(); ++i) {
+        if (g_sleepers[i] == &sleeper) {
+            g_sleepers[i] = g_sleepers.back();
+            g_sleepers.pop_back();
+            sleeper.woken = true;
+            break;
+        }
+    }
+    sleeper.cv.notify_one();
+}
+
+// 登记延时并等待被唤醒（到期或被通知），调用者必须持有 g_clock_mutex
+static void virtual_wait_locked(std::unique_lock<std::mutex>& lock, VirtualSleeper& self, uint64_t deadline) {
+    self.deadline = deadline;
+    self.woken = false;
+    g_sleepers.push_back(&self);
+    advance_locked();
+    while (!self.woken) {
+        self.cv.wait(lock);
+    }
+}
+
+static void virtual_sleep_until(uint64_t deadline) {
+    std::unique_lock<std::mutex> lock(g_clock_mutex);
+    VirtualSleeper self;
+    virtual_wait_locked(lock, self, deadline);
+}
+
+extern "C" {
+
+void simClockSetMode(sim_clock_mode_t mode) {
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    g_clock_mode.store(mode);
+    g_virtual_now_ns.store(0);
+    // 正在等待的后台线程按旧时钟计算的期限已失效，唤醒它们按新模式重新等待
+    for (SimClockWaiter* waiter : g_waiters) {
+        if (waiter->waiting) {
+            waiter->interrupted = true;
+            wake_waiter_locked(waiter);
+        }
+    }
+    sim_clock_reset_hook_t hook = g_reset_hook.load();
+    if (hook) hook(mode);
+}
+
+sim_clock_mode_t simClockGetMode(void) {
+    return (sim_clock_mode_t)g_clock_mode.load(std::memory_order_relaxed);
+}
+
+uint64_t simClockNowNs(void) {
+    if (g_clock_mode.load(std::memory_order_relaxed) == SIM_CLOCK_VIRTUAL) {
+        return g_virtual_now_ns.load(std::memory_order_acquire);
+    }
+    return real_now_ns();
+}
+
+void simClockSleepNs(uint64_t ns) {
+    if (g_clock_mode.load(std::memory_order_relaxed) == SIM_CLOCK_VIRTUAL) {
+        virtual_sleep_until(g_virtual_now_ns.load(std::memory_order_acquire) + ns);
+    } else {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+    }
+}
+
+void simClockSleepMs(unsigned long ms) {
+    simClockSleepNs((uint64_t)ms * 1000000u);
+}
+
+void simClockThreadBegin(void) {
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    ++g_participants;
+}
+
+void simClockThreadEnd(void) {
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    --g_participants;
+    advance_locked(); // 剩下的参与线程可能都已在等待
+}
+
+SimClockWaiter* simClockWaiterCreate(void) {
+    SimClockWaiter* waiter = new SimClockWaiter();
+    waiter->waiting = false;
+    waiter->pending = false;
+    waiter->interrupted = false;
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    g_waiters.push_back(waiter);
+    return waiter;
+}
+
+void simClockWaiterDestroy(SimClockWaiter* waiter) {
+    {
+        std::lock_guard<std::mutex> lock(g_clock_mutex);
+        for (size_t i = 0; i < g_waiters.size(); ++i) {
+            if (g_waiters[i] == waiter) {
+                g_waiters[i] = g_waiters.back();
+                g_waiters.pop_back();
+                break;
+            }
+        }
+    }
+    delete waiter;
+}
+
+bool simClockWaiterWait(SimClockWaiter* waiter, uint64_t deadline_ns) {
+    std::unique_lock<std::mutex> lock(g_clock_mutex);
+    if (!waiter->pending) {
+        waiter->waiting = true;
+        waiter->interrupted = false;
+        auto ready = [waiter] { return waiter->pending || waiter->interrupted; };
+        if (g_clock_mode.load(std::memory_order_relaxed) == SIM_CLOCK_VIRTUAL) {
+            if (deadline_ns > g_virtual_now_ns.load(std::memory_order_relaxed)) {
+                virtual_wait_locked(lock, waiter->sleeper, deadline_ns);
+            }
+        } else if (deadline_ns == SIM_CLOCK_FOREVER) {
+            waiter->sleeper.cv.wait(lock, ready);
+        } else {
+            std::chrono::steady_clock::time_point until{std::chrono::nanoseconds(deadline_ns)};
+            waiter->sleeper.cv.wait_until(lock, until, ready);
+        }
+        waiter->waiting = false;
+    }
+    bool notified = waiter->pending;
+    waiter->pending = false;
+    return notified;
+}
+
+void simClockWaiterNotify(SimClockWaiter* waiter) {
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    waiter->pending = true;
+    if (waiter->waiting) wake_waiter_locked(waiter);
+}
+
+void simClockSetHooks(sim_clock_advance_hook_t advance, sim_clock_reset_hook_t reset) {
+    std::lock_guard<std::mutex> lock(g_clock_mutex);
+    g_advance_hook.store(advance);
+    g_reset_hook.store(reset);
+}
+
+} // extern "C"
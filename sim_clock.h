@@ -0,0 +1,92 @@
+#ifndef _SIM_CLOCK_H_
+#define _SIM_CLOCK_H_
+
+// PC 模拟器使用的可切换时钟。所有延时（tone() 的持续时间、delay_ms() 等）都通过这里，
+// 实时模式下就是普通的 sleep；虚拟时间模式下延时只推进模拟时钟，不占用实际时间，
+// 音频渲染器在时钟推进时补齐对应数量的采样帧，输出与实时播放一致且每次运行逐位相同。
+
+#include <stdint.h>
+
+typedef enum {
+    SIM_CLOCK_REAL = 0, // 实时：延时真实等待，时间取自单调时钟（默认）
+    SIM_CLOCK_VIRTUAL,  // 虚拟时间：延时立即返回并推进模拟时钟
+} sim_clock_mode_t;
+
+#define SIM_CLOCK_FOREVER (~(uint64_t)0) // simClockWaiterWait 的无限期限
+
+// 可被其他线程提前唤醒的定时等待，用于"等到期限或有新工作"的后台线程
+typedef struct SimClockWaiter SimClockWaiter;
+
+// 时钟即将推进到 now_ns 时调用，调用期间所有参与线程都在等待
+typedef void (*sim_clock_advance_hook_t)(uint64_t now_ns);
+// 切换时钟模式后调用，此时没有线程在延时中
+typedef void (*sim_clock_reset_hook_t)(sim_clock_mode_t mode);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 切换时钟模式。每次调用都会把虚拟时间清零，便于重复运行同一段测试。
+ *        必须在没有线程处于延时中时调用。
+ */
+void simClockSetMode(sim_clock_mode_t mode);
+
+/**
+ * @brief 获取当前时钟模式。
+ */
+sim_clock_mode_t simClockGetMode(void);
+
+/**
+ * @brief 当前时间（纳秒）。实时模式下为单调时钟，虚拟模式下为切换模式以来的模拟时间。
+ */
+uint64_t simClockNowNs(void);
+
+/**
+ * @brief 延时指定的纳秒数 / 毫秒数。
+ */
+void simClockSleepNs(uint64_t ns);
+void simClockSleepMs(unsigned long ms);
+
+/**
+ * @brief 声明调用线程会使用模拟时钟延时。
+ *        虚拟时间只在所有参与线程都处于延时中时才向前推进（推进到最早的唤醒时间），
+ *        主线程默认已参与；其他调用 simClockSleep* 的线程必须在开始时调用 simClockThreadBegin、
+ *        退出前调用 simClockThreadEnd，否则虚拟时间会在它运行时提前推进。
+ */
+void simClockThreadBegin(void);
+void simClockThreadEnd(void);
+
+/**
+ * @brief 创建 / 销毁一个可唤醒的等待对象。
+ */
+SimClockWaiter* simClockWaiterCreate(void);
+void simClockWaiterDestroy(SimClockWaiter* waiter);
+
+/**
+ * @brief 等待到绝对时间 deadline_ns（simClockNowNs 的时间基准），或被 simClockWaiterNotify 提前唤醒。
+ *        虚拟时间模式下等待中的线程与延时中的线程一样，不会阻止时间推进。
+ *        同一时间只能有一个线程在同一个对象上等待。
+ *
+ * @param deadline_ns 期限，SIM_CLOCK_FOREVER 表示只等通知。
+ *        等待期间切换时钟模式会提前返回 false，调用者应按新的时钟重新计算期限。
+ * @return 被通知时返回 true（等待之前已到达的通知也算），到期返回 false。
+ */
+bool simClockWaiterWait(SimClockWaiter* waiter, uint64_t deadline_ns);
+
+/**
+ * @brief 唤醒在 waiter 上等待的线程；没有线程在等待时，下一次等待立即返回。
+ */
+void simClockWaiterNotify(SimClockWaiter* waiter);
+
+/**
+ * @brief 注册时钟事件的回调（同一时间只支持一组，传 NULL 取消）。
+ *        回调在持有时钟内部锁时调用，不能再调用 simClock* 函数。
+ */
+void simClockSetHooks(sim_clock_advance_hook_t advance, sim_clock_reset_hook_t reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SIM_CLOCK_H_ */